@@ -0,0 +1,416 @@
+/** @file bench.c
+ *  @author T J Atherton
+ *
+ *  @brief Headless benchmark of the parser and scene preparation
+ *  @details Runs each stage of loading a scene over a set of command files and reports its throughput and the
+ *           peak memory use of the process on completion. Scenes are collected by a sink rather than displayed, so
+ *           no window or OpenGL context is needed; buffer layout is performed on the CPU only.
+ *
+ *           A scene of many small objects may be generated in place of a file with -o, e.g. to check that
+ *           preparation takes time in proportion to the number of objects. With -s, the calls made to draw each
+ *           frame are also counted, before and after the render list is compiled.
+ *
+ *  Usage: morphoview-bench [-n repeats] [-j threads] [-s] [-o objects] file ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdarg.h>
+
+#include "command.h"
+#include "render.h"
+#include "text.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+/** Number of times each stage is run by default; the fastest is reported */
+#define BENCH_REPEATS 5
+
+/** Number of colors selected between in generated scenes */
+#define BENCH_COLORS 16
+
+/** Whether to report the calls made to draw each frame */
+static bool benchstats = false;
+
+/* -------------------------------------------------------
+ * Scene sink
+ * ------------------------------------------------------- */
+
+DECLARE_VARRAY(scene, scene *);
+DEFINE_VARRAY(scene, scene *);
+
+/** Scenes created by the most recent parse */
+static varray_scene scenes;
+
+/** Collects scenes in place of opening a window for them */
+static void *bench_sinkopen(void *ref, scene *s) {
+    varray_scenewrite(&scenes, s);
+    return NULL;
+}
+
+/** Receives scenes from the parser */
+static scenesink sink = { .open = bench_sinkopen };
+
+/** Frees scenes collected by the stubs */
+static void bench_freescenes(void) {
+    for (unsigned int i=0; i<scenes.count; i++) scene_free(scenes.data[i]);
+    scenes.count=0;
+}
+
+/* -------------------------------------------------------
+ * Measurement
+ * ------------------------------------------------------- */
+
+/** @brief Results of a stage */
+typedef struct {
+    double time; /** Fastest time in seconds */
+    double bytes; /** Bytes processed by each run */
+    double numbers; /** Numbers processed by each run, or 0 if not meaningful */
+} benchresult;
+
+/** Returns the current time in seconds */
+static double bench_time(void) {
+    struct timespec t;
+    timespec_get(&t, TIME_UTC);
+    return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+/** Returns the peak resident memory of the process in MB */
+static double bench_peakmemory(void) {
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)!=0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss/1048576.0; /* Reported in bytes */
+#else
+    return usage.ru_maxrss/1024.0; /* Reported in kilobytes */
+#endif
+#else
+    return 0;
+#endif
+}
+
+/** Prints a line of results */
+static void bench_report(const char *stage, benchresult *r) {
+    double t = (r->time>0 ? r->time : 1e-9);
+    
+    printf("  %-14s %10.4f %10.1f ", stage, r->time, r->bytes/t/1048576.0);
+    if (r->numbers>0) printf("%12.2f", r->numbers/t/1e6);
+    else printf("%12s", "-");
+    printf(" %12.1f\n", bench_peakmemory());
+}
+
+/* -------------------------------------------------------
+ * Stages
+ * ------------------------------------------------------- */
+
+/** Lexes the whole input, optionally with the structural index */
+static bool bench_lex(commandinput *input, bool indexed, benchresult *r) {
+    structuralindex *index = NULL;
+    if (indexed) {
+        index = malloc(sizeof(structuralindex));
+        if (!index) return false;
+        structural_init(index, input->data, input->length);
+    }
+    
+    lexer l;
+    command_lexinit(&l, input->data);
+    l.index=index;
+    
+    token tok = { .type = TOKEN_NONE };
+    bool success=true;
+    r->numbers=0;
+    
+    while (tok.type!=TOKEN_EOF) {
+        if (!command_lex(&l, &tok)) {
+            fprintf(stderr, "morphoview-bench: Unrecognized token.\n");
+            success=false;
+            break;
+        }
+        if (tok.type==TOKEN_INTEGER || tok.type==TOKEN_FLOAT) r->numbers++;
+    }
+    
+    free(index);
+    r->bytes=input->length;
+    return success;
+}
+
+/** Parses the input, leaving the resulting scenes in the scene list */
+static bool bench_parse(commandinput *input, benchresult *r) {
+    bench_freescenes();
+    if (!command_parseinput(input, &sink)) return false;
+    
+    r->bytes=input->length;
+    r->numbers=0;
+    for (unsigned int i=0; i<scenes.count; i++) {
+        r->numbers+=scenes.data[i]->data.count + scenes.data[i]->indx.count + scenes.data[i]->colors.count;
+    }
+    return true;
+}
+
+/** Generates the texture atlas for every font */
+static bool bench_fonts(benchresult *r) {
+    r->bytes=0;
+    r->numbers=0;
+    
+    for (unsigned int i=0; i<scenes.count; i++) {
+        scene *s = scenes.data[i];
+        for (unsigned int j=0; j<s->fontlist.count; j++) {
+            textfont *font = &s->fontlist.data[j].font;
+            if (!text_generatetexture(font)) return false;
+            r->bytes+=font->skyline.width*font->skyline.height;
+        }
+    }
+    return true;
+}
+
+/** Lays out vertex and element buffers as render_preparescene does, copying the data into memory rather than
+ *  OpenGL buffers, and creates the render list */
+static bool bench_layout(benchresult *r) {
+    r->bytes=0;
+    r->numbers=0;
+    
+    for (unsigned int i=0; i<scenes.count; i++) {
+        scene *s = scenes.data[i];
+        renderer rend;
+        render_initlayout(&rend);
+        
+        render_layoutscene(&rend, s);
+        
+        bool success=true;
+        for (unsigned int j=0; j<rend.glbuffers.count && success; j++) {
+            renderglbuffers *b = &rend.glbuffers.data[j];
+            float *vertices = malloc(sizeof(float)*(b->vlength+1));
+            unsigned int *elements = malloc(sizeof(unsigned int)*(b->elength+1));
+            success=(vertices && elements);
+            
+            for (unsigned int k=0; k<rend.objects.count && success; k++) {
+                renderobject *obj = &rend.objects.data[k];
+                if (obj->buffer!=b) continue;
+                
+                float *data = scene_vertexdata(s, obj->obj);
+                if (data && obj->obj->vertexdata.length>0) {
+                    memcpy(vertices+obj->voffset, data, sizeof(float)*obj->obj->vertexdata.length);
+                }
+                
+                /* Vertex indices are copied unchanged, as each draw supplies the object's base vertex */
+                int offset = obj->eoffset;
+                for (unsigned int m=0; m<obj->obj->elements.count; m++) {
+                    gelement *el = &obj->obj->elements.data[m];
+                    int *indices = scene_elementdata(s, el);
+                    if (indices && el->length>0) memcpy(elements+offset, indices, sizeof(unsigned int)*el->length);
+                    offset+=el->length;
+                }
+            }
+            
+            r->bytes+=sizeof(float)*b->vlength + sizeof(unsigned int)*b->elength;
+            r->numbers+=b->vlength + b->elength;
+            free(vertices);
+            free(elements);
+        }
+        
+        if (success) render_compilescene(&rend, s);
+        
+        render_clearlayout(&rend);
+        
+        if (!success) {
+            fprintf(stderr, "morphoview-bench: Couldn't allocate buffers.\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+/** Reports the calls made to draw each frame of the scenes, in display list order and once compiled */
+static void bench_liststats(void) {
+    renderstats before = { .draws = 0 }, after = { .draws = 0 };
+    
+    for (unsigned int i=0; i<scenes.count; i++) {
+        renderer rend;
+        render_initlayout(&rend);
+        render_layoutscene(&rend, scenes.data[i]);
+        
+        /* Stand-in handles, so that vertex arrays are bound as they would be with OpenGL */
+        for (unsigned int j=0; j<rend.glbuffers.count; j++) rend.glbuffers.data[j].array=j+1;
+        
+        render_compilescene(&rend, scenes.data[i]);
+        
+        renderstats b, a;
+        render_liststats(&rend, &b, &a);
+        before.draws+=b.draws; before.arrays+=b.arrays; before.models+=b.models; before.colors+=b.colors;
+        after.draws+=a.draws; after.arrays+=a.arrays; after.models+=a.models; after.colors+=a.colors;
+        
+        render_clearlayout(&rend);
+    }
+    
+    printf("  %-14s %10s %10s %12s %12s\n", "calls/frame", "draws", "arrays", "models", "colors");
+    printf("  %-14s %10i %10i %12i %12i\n", "display order", before.draws, before.arrays, before.models, before.colors);
+    printf("  %-14s %10i %10i %12i %12i\n", "compiled", after.draws, after.arrays, after.models, after.colors);
+}
+
+/* -------------------------------------------------------
+ * Run the benchmark
+ * ------------------------------------------------------- */
+
+/** @brief Identifies the stages */
+typedef enum {
+    BENCH_LEXSCALAR,
+    BENCH_LEXINDEXED,
+    BENCH_PARSE,
+    BENCH_FONTS,
+    BENCH_LAYOUT,
+    BENCH_NSTAGES
+} benchstage;
+
+static const char *benchstagenames[BENCH_NSTAGES] = {
+    "lex (scalar)",
+    "lex (indexed)",
+    "parse",
+    "fonts",
+    "layout"
+};
+
+/** Runs a single stage */
+static bool bench_runstage(benchstage stage, commandinput *input, benchresult *r) {
+    switch (stage) {
+        case BENCH_LEXSCALAR: return bench_lex(input, false, r);
+        case BENCH_LEXINDEXED: return bench_lex(input, true, r);
+        case BENCH_PARSE: return bench_parse(input, r);
+        case BENCH_FONTS: return bench_fonts(r);
+        case BENCH_LAYOUT: return bench_layout(r);
+        default: return false;
+    }
+}
+
+/** Benchmarks each stage over an input, which is then freed */
+static bool bench_input(const char *name, commandinput *in, int repeats) {
+    commandinput input = *in;
+    
+    printf("%s: %.1f MB%s\n", name, input.length/1048576.0, (input.format==COMMAND_BINARY ? " (binary)" : ""));
+    printf("  %-14s %10s %10s %12s %12s\n", "stage", "time (s)", "MB/s", "Mnumbers/s", "peak RSS (MB)");
+    
+    bool success=true;
+    for (benchstage stage=0; stage<BENCH_NSTAGES && success; stage++) {
+        /* Binary input isn't lexed */
+        if (input.format==COMMAND_BINARY && (stage==BENCH_LEXSCALAR || stage==BENCH_LEXINDEXED)) continue;
+        
+        benchresult r = { .time = -1 };
+        for (int k=0; k<repeats && success; k++) {
+            double start=bench_time();
+            success=bench_runstage(stage, &input, &r);
+            double t=bench_time()-start;
+            if (r.time<0 || t<r.time) r.time=t;
+        }
+        
+        if (success) bench_report(benchstagenames[stage], &r);
+        else fprintf(stderr, "morphoview-bench: Stage '%s' failed for '%s'.\n", benchstagenames[stage], name);
+    }
+    
+    if (success && benchstats) bench_liststats();
+    
+    bench_freescenes();
+    command_freeinput(&input);
+    return success;
+}
+
+/** Benchmarks each stage over a file */
+static bool bench_file(const char *file, int repeats) {
+    commandinput input;
+    if (!command_loadinput(file, &input)) return false;
+    
+    return bench_input(file, &input, repeats);
+}
+
+/** Appends formatted text to a buffer */
+static void bench_printf(varray_char *out, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int n=vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    
+    if (n>0) varray_charadd(out, line, (n<sizeof(line) ? n : sizeof(line)-1));
+}
+
+/** Benchmarks each stage over a generated scene of many small objects, each drawn once with its own color selection
+ *  and some with their own transformation, so that the time taken by id lookups during layout dominates. The time
+ *  taken should grow in proportion to the number of objects. */
+static bool bench_objects(int nobjects, int repeats) {
+    varray_char text;
+    varray_charinit(&text);
+    
+    bench_printf(&text, "S 1 3\n");
+    for (int i=0; i<BENCH_COLORS; i++) {
+        bench_printf(&text, "c %i %g %g %g\n", i, (float) i/BENCH_COLORS, 0.5, 1.0-(float) i/BENCH_COLORS);
+    }
+    
+    for (int i=0; i<nobjects; i++) {
+        float x = (float) (i%1000)/1000, y = (float) (i/1000)/1000;
+        
+        /* Alternate between two formats, and so two buffers */
+        bench_printf(&text, "o %i\nv \"%s\" ", i, (i%2 ? "xc" : "x"));
+        for (int k=0; k<3; k++) {
+            bench_printf(&text, "%g %g 0 ", x+(k==1 ? 0.001 : 0), y+(k==2 ? 0.001 : 0));
+            if (i%2) bench_printf(&text, "1 1 1 ");
+        }
+        bench_printf(&text, "\nf 0 1 2\nC %i\n", i%BENCH_COLORS);
+        if (i%16==0) bench_printf(&text, "t 0 0 0.001\n");
+        bench_printf(&text, "d %i\n", i);
+    }
+    
+    commandinput input = { .data = NULL, .length = text.count, .maplength = 0, .format = COMMAND_TEXT };
+    varray_charwrite(&text, '\0');
+    input.data=text.data; /* Freed with the input */
+    
+    char name[64];
+    snprintf(name, sizeof(name), "%i objects", nobjects);
+    return bench_input(name, &input, repeats);
+}
+
+int main(int argc, const char * argv[]) {
+    int repeats=BENCH_REPEATS;
+    bool success=true;
+    int nfiles=0;
+    
+    scene_initialize();
+    text_initialize();
+    varray_sceneinit(&scenes);
+    
+    for (int i=1; i<argc; i++) {
+        const char *option = argv[i];
+        if (option[0]=='-' && option[1]=='s' && option[2]=='\0') { /* The only option without a value */
+            benchstats=true;
+        } else if (option[0]=='-' && option[1]!='\0') {
+            const char *value = (option[2]!='\0' ? option+2 : (i+1<argc ? argv[++i] : "0"));
+            switch (option[1]) {
+                case 'n': repeats=atoi(value); break;
+                case 'j': command_setthreads(atoi(value)); break;
+                case 'o':
+                    if (!bench_objects(atoi(value), (repeats>0 ? repeats : 1))) success=false;
+                    nfiles++;
+                    break;
+                default:
+                    fprintf(stderr, "morphoview-bench: Unknown option '%s'.\n", option);
+                    return 1;
+            }
+        } else {
+            if (!bench_file(option, (repeats>0 ? repeats : 1))) success=false;
+            nfiles++;
+        }
+    }
+    
+    if (nfiles==0) {
+        fprintf(stderr, "Usage: morphoview-bench [-n repeats] [-j threads] [-s] [-o objects] file ...\n");
+        success=false;
+    }
+    
+    varray_sceneclear(&scenes);
+    text_finalize();
+    scene_finalize();
+    
+    return (success ? 0 : 1);
+}
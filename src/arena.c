@@ -0,0 +1,118 @@
+/** @file arena.c
+ *  @author T J Atherton
+ *
+ *  @brief Bump allocator for the many small, variable-size pieces of a scene
+ *  @details Allocations are carved in turn from large chunks, and can't be freed individually; clearing the arena
+ *           frees every chunk at once. Allocations larger than a quarter of a chunk are given a chunk of their own.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "arena.h"
+
+/** Rounds a size up to the alignment of allocations */
+static size_t arena_round(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+}
+
+/** Start of the memory available in a chunk */
+static char *arena_base(arenachunk *c) {
+    return (char *) (c+1);
+}
+
+/** Allocates a new chunk with at least size bytes available; if current is true it becomes the chunk allocated
+ *  from, otherwise it is placed behind it */
+static arenachunk *arena_newchunk(arena *a, size_t size, bool current) {
+    arenachunk *c = malloc(sizeof(arenachunk)+size);
+    if (!c) return NULL;
+    
+    c->size=size;
+    c->used=0;
+    c->last=NULL;
+    
+    if (current || !a->chunks) {
+        c->next=a->chunks;
+        a->chunks=c;
+    } else {
+        c->next=a->chunks->next;
+        a->chunks->next=c;
+    }
+    return c;
+}
+
+/* -------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------- */
+
+/** Initializes an empty arena; no memory is allocated until it is first used */
+void arena_init(arena *a) {
+    a->chunks=NULL;
+}
+
+/** Frees everything allocated from an arena */
+void arena_clear(arena *a) {
+    arenachunk *next=NULL;
+    for (arenachunk *c=a->chunks; c; c=next) {
+        next=c->next;
+        free(c);
+    }
+    a->chunks=NULL;
+}
+
+/** Allocates memory from an arena
+ *  @param[in] a - the arena
+ *  @param[in] size - size in bytes
+ *  @returns the memory, aligned to ARENA_ALIGN, or NULL on failure */
+void *arena_alloc(arena *a, size_t size) {
+    size=arena_round(size);
+    
+    arenachunk *c = a->chunks;
+    if (!c || c->size-c->used<size) {
+        if (size>ARENA_CHUNKSIZE/4) c=arena_newchunk(a, size, false);
+        else c=arena_newchunk(a, ARENA_CHUNKSIZE, true);
+        if (!c) return NULL;
+    }
+    
+    c->last=arena_base(c)+c->used;
+    c->used+=size;
+    return c->last;
+}
+
+/** Grows an allocation, in place if it was the most recent one and there is room; otherwise it is copied
+ *  @param[in] a - the arena
+ *  @param[in] ptr - the allocation, or NULL
+ *  @param[in] oldsize - its present size in bytes
+ *  @param[in] newsize - the size needed
+ *  @returns the allocation, which may have moved, or NULL on failure, leaving the old allocation in place */
+void *arena_grow(arena *a, void *ptr, size_t oldsize, size_t newsize) {
+    arenachunk *c = a->chunks;
+    
+    if (ptr && c && ptr==c->last) {
+        size_t start = c->last-arena_base(c);
+        size_t size = arena_round(newsize);
+        if (size<=c->size-start) {
+            c->used=start+size;
+            return ptr;
+        }
+    }
+    
+    void *new = arena_alloc(a, newsize);
+    if (new && ptr) memcpy(new, ptr, oldsize);
+    return new;
+}
+
+/** Copies a string into an arena
+ *  @param[in] a - the arena
+ *  @param[in] str - the string, which needn't be terminated
+ *  @param[in] length - its length in characters
+ *  @returns the terminated copy, or NULL on failure */
+char *arena_string(arena *a, const char *str, size_t length) {
+    char *out = arena_alloc(a, length+1);
+    if (out) {
+        memcpy(out, str, length);
+        out[length]='\0';
+    }
+    return out;
+}
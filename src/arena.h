@@ -0,0 +1,42 @@
+/** @file arena.h
+ *  @author T J Atherton
+ *
+ *  @brief Bump allocator for the many small, variable-size pieces of a scene
+ */
+
+#ifndef arena_h
+#define arena_h
+
+#include <stddef.h>
+
+/** Size in bytes of each chunk the arena allocates from */
+#define ARENA_CHUNKSIZE 65536
+
+/** Alignment of every allocation in bytes; a power of two */
+#define ARENA_ALIGN 8
+
+/** @brief A block of memory that allocations are carved from */
+typedef struct sarenachunk {
+    struct sarenachunk *next; /** Linked list */
+    size_t size; /** Bytes available in the chunk */
+    size_t used; /** Bytes allocated so far */
+    char *last; /** Most recent allocation, which can be grown in place */
+} arenachunk;
+
+/** @brief Allocations that are only freed together, by clearing the arena */
+typedef struct {
+    arenachunk *chunks; /** The chunk being allocated from is first */
+} arena;
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+void arena_init(arena *a);
+void arena_clear(arena *a);
+
+void *arena_alloc(arena *a, size_t size);
+void *arena_grow(arena *a, void *ptr, size_t oldsize, size_t newsize);
+char *arena_string(arena *a, const char *str, size_t length);
+
+#endif /* arena_h */
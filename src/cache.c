@@ -0,0 +1,223 @@
+/** @file cache.c
+ *  @author T J Atherton
+ *
+ *  @brief Cache of parsed scenes, keyed by the contents of the input
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "mvb.h"
+#include "varray.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Scenes parsed from a text command file are written to the cache in the .mvb format, in a file named by a hash
+   and the length of the command file. Opening the same file again reads the .mvb file instead, which copies the
+   numerical data straight into the scenes rather than lexing and converting it. The cache lives in
+   $XDG_CACHE_HOME/morphoview, or ~/.cache/morphoview if that isn't set. */
+
+/* -------------------------------------------------------
+ * Recording scenes
+ * ------------------------------------------------------- */
+
+/** @brief A scene recorded as it passes from the parser to the sink */
+typedef struct {
+    scene *scene;
+    char *title; /** Window title, or NULL */
+} cacheentry;
+
+DECLARE_VARRAY(cacheentry, cacheentry);
+DEFINE_VARRAY(cacheentry, cacheentry);
+
+/** @brief Records scenes on their way to another sink */
+typedef struct {
+    scenesink *target;
+    varray_cacheentry entries;
+} cacherecorder;
+
+static void *cache_recordopen(void *ref, scene *s) {
+    cacherecorder *rec = (cacherecorder *) ref;
+    cacheentry entry = { .scene = s, .title = NULL };
+    varray_cacheentrywrite(&rec->entries, entry);
+    return scene_sinkopen(rec->target, s);
+}
+
+static void cache_recordsettitle(void *ref, void *handle, char *title) {
+    cacherecorder *rec = (cacherecorder *) ref;
+    
+    /* The title belongs to the most recently opened scene */
+    if (rec->entries.count>0) {
+        cacheentry *entry = &rec->entries.data[rec->entries.count-1];
+        free(entry->title);
+        entry->title=malloc(strlen(title)+1);
+        if (entry->title) strcpy(entry->title, title);
+    }
+    
+    scene_sinksettitle(rec->target, handle, title);
+}
+
+static void cache_recordprepare(void *ref, void *handle, scene *s) {
+    scene_sinkprepare(((cacherecorder *) ref)->target, handle, s);
+}
+
+static bool cache_recordisopen(void *ref, void *handle) {
+    return scene_sinkisopen(((cacherecorder *) ref)->target, handle);
+}
+
+static void cache_recordupdate(void *ref) {
+    scene_sinkupdate(((cacherecorder *) ref)->target);
+}
+
+/* -------------------------------------------------------
+ * Cache files
+ * ------------------------------------------------------- */
+
+/** Makes a directory unless it already exists */
+static bool cache_makedirectory(const char *path) {
+#ifdef _WIN32
+    int err = _mkdir(path);
+#else
+    int err = mkdir(path, 0755);
+#endif
+    return (err==0 || errno==EEXIST);
+}
+
+/** Finds the cache directory, creating it if necessary
+ *  @param[out] out - buffer to hold the path
+ *  @param[in] size - size of the buffer
+ *  @returns true on success */
+static bool cache_directory(char *out, size_t size) {
+    char parent[CACHE_MAXPATH];
+    const char *base = getenv("XDG_CACHE_HOME");
+    int n;
+    
+    if (base && base[0]!='\0') {
+        n=snprintf(parent, sizeof(parent), "%s", base);
+#ifdef _WIN32
+    } else if ((base=getenv("LOCALAPPDATA"))) {
+        n=snprintf(parent, sizeof(parent), "%s", base);
+#endif
+    } else if ((base=getenv("HOME"))) {
+        n=snprintf(parent, sizeof(parent), "%s/.cache", base);
+    } else return false;
+    
+    if (n<0 || n>=(int) sizeof(parent) || !cache_makedirectory(parent)) return false;
+    
+    n=snprintf(out, size, "%s/%s", parent, CACHE_DIRECTORY);
+    return (n>0 && n<(int) size && cache_makedirectory(out));
+}
+
+/** Finds the path of the cache file for an input
+ *  @param[in] input - the input
+ *  @param[out] out - buffer to hold the path
+ *  @param[in] size - size of the buffer
+ *  @returns true on success */
+static bool cache_path(commandinput *input, char *out, size_t size) {
+    char dir[CACHE_MAXPATH];
+    if (!cache_directory(dir, sizeof(dir))) return false;
+    
+    uint64_t hash = hash_bytes(input->data, input->length, ((uint64_t) CACHE_VERSION << 32) | MVB_VERSION);
+    int n=snprintf(out, size, "%s/%016llx-%llx.mvb", dir, (unsigned long long) hash, (unsigned long long) input->length);
+    return (n>0 && n<(int) size);
+}
+
+/** Checks whether a file exists */
+static bool cache_exists(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f) fclose(f);
+    return (f!=NULL);
+}
+
+/** Writes recorded scenes to a cache file; the file is written under a temporary name and then renamed, so that
+ *  it is never seen incomplete */
+static bool cache_store(const char *path, cacherecorder *rec) {
+    char temp[CACHE_MAXPATH];
+#ifdef _WIN32
+    long pid = (long) _getpid();
+#else
+    long pid = (long) getpid();
+#endif
+    int n=snprintf(temp, sizeof(temp), "%s.%ld.tmp", path, pid);
+    if (n<0 || n>=(int) sizeof(temp)) return false;
+    
+    FILE *f = fopen(temp, "wb");
+    if (!f) return false;
+    
+    bool success=mvb_writeheader(f);
+    for (unsigned int i=0; i<rec->entries.count && success; i++) {
+        success=mvb_writescene(f, rec->entries.data[i].scene, rec->entries.data[i].title);
+    }
+    
+    if (fclose(f)!=0) success=false;
+    if (success) success=(rename(temp, path)==0);
+    if (!success) remove(temp);
+    
+    return success;
+}
+
+/* -------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------- */
+
+/** Parses a file loaded with command_loadinput, reusing the scenes from an earlier parse of identical contents
+ *  if they are in the cache and otherwise storing them there.
+ *  @param[in] input - the input
+ *  @param[in] sink - receives the scenes, or NULL
+ *  @returns true on success */
+bool cache_parseinput(commandinput *input, scenesink *sink) {
+    char path[CACHE_MAXPATH];
+    
+    /* Binary input is already quick to load */
+    if (input->format!=COMMAND_TEXT || !cache_path(input, path, sizeof(path))) {
+        return command_parseinput(input, sink);
+    }
+    
+    if (cache_exists(path)) {
+        commandinput cached;
+        
+        if (command_loadinput(path, &cached)) {
+            bool binary = (cached.format==COMMAND_BINARY);
+            bool success = (binary && mvb_parse(cached.data, cached.length, sink));
+            command_freeinput(&cached);
+            if (success) return true;
+            
+            /* Scenes may already have been created from a damaged file, so don't parse them again */
+            if (binary) {
+                fprintf(stderr, "morphoview: Removed damaged cache file %s.\n", path);
+                remove(path);
+                return false;
+            }
+        }
+        remove(path);
+    }
+    
+    /* Parse the input, recording the scenes so that they can be stored */
+    cacherecorder rec;
+    rec.target=sink;
+    varray_cacheentryinit(&rec.entries);
+    
+    scenesink recorder = { .open = cache_recordopen, .settitle = cache_recordsettitle,
+                           .prepare = cache_recordprepare, .isopen = cache_recordisopen,
+                           .update = cache_recordupdate, .ref = &rec };
+    
+    bool success=command_parseinput(input, &recorder);
+    if (success && !cache_store(path, &rec)) {
+        fprintf(stderr, "morphoview: Couldn't write cache file %s.\n", path);
+    }
+    
+    for (unsigned int i=0; i<rec.entries.count; i++) free(rec.entries.data[i].title);
+    varray_cacheentryclear(&rec.entries);
+    
+    return success;
+}
@@ -0,0 +1,28 @@
+/** @file cache.h
+ *  @author T J Atherton
+ *
+ *  @brief Cache of parsed scenes, keyed by the contents of the input
+ */
+
+#ifndef cache_h
+#define cache_h
+
+#include <stdbool.h>
+#include "command.h"
+
+/** Name of the directory within the user's cache directory that holds the cache */
+#define CACHE_DIRECTORY "morphoview"
+
+/** Version of the cache; changing this invalidates existing entries */
+#define CACHE_VERSION 1
+
+/** Maximum length of a path in the cache */
+#define CACHE_MAXPATH 4096
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+bool cache_parseinput(commandinput *input, scenesink *sink);
+
+#endif /* cache_h */
@@ -3,13 +3,33 @@
  *
  *  @brief Command language for morphoview
  */
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 
 #include "command.h"
+#include "numeric.h"
+#include "mvb.h"
 #include "memory.h"
 #include "varray.h"
-#include "display.h"
+
+#ifdef COMMAND_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef COMMAND_POLL
+#include <errno.h>
+#include <poll.h>
+#endif
+
+#ifdef COMMAND_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 /** Get the size of an open file
  *  @param[in] f file handle
@@ -38,46 +58,147 @@ void command_removefile(const char *in) {
     }
 }
 
-/** Returns the contents of a file as a string
- *  @param[in] in file name
- *  @param[out] out a string with the contents of the file. Call MORPHO_FREE on this once done.
+/** Reads the contents of a stream into a newly allocated buffer; used for pipes and where mapping isn't available
+ *  @param[in] f stream to read from
+ *  @param[out] input filled out with the buffer
  *  @returns bool indicating success. */
-bool command_loadinput(const char *in, char **out) {
-    FILE *f=NULL;
+static bool command_readinput(FILE *f, commandinput *input) {
     varray_char buffer;
-    
     varray_charinit(&buffer);
     
-    f=fopen(in, "r");
-    if (!f) {
-        fprintf(stderr, "morphoview: Couldn't open input file %s.\n", in);
-        goto loadinput_cleanup;
+    /* Size the buffer to match the file if possible */
+    size_t size=0;
+    if (!command_getfilesize(f, &size)) size=0;
+    size_t chunk = (size>0 ? size : COMMAND_READCHUNK);
+    
+    /* Read in the file directly into the buffer */
+    for (;;) {
+        if (!varray_charresize(&buffer, (int) chunk+1)) {
+            fprintf(stderr, "morphoview: Couldn't allocate buffer to load input file.\n");
+            varray_charclear(&buffer);
+            return false;
+        }
+        
+        size_t n = fread(buffer.data+buffer.count, sizeof(char), chunk, f);
+        buffer.count+=(int) n;
+        if (n<chunk) break;
+        chunk=COMMAND_READCHUNK;
     }
     
-    /* Determine the file size */
-    size_t size;
-    if (!command_getfilesize(f, &size)) goto loadinput_cleanup;
+    if (ferror(f)) {
+        fprintf(stderr, "morphoview: Error reading input file.\n");
+        varray_charclear(&buffer);
+        return false;
+    }
     
-    if (size) {
-        /* Size the buffer to match */
-        if (!varray_charresize(&buffer, (int) size+1)) {
-            fprintf(stderr, "morphoview: Couldn't allocate buffer to load input file.\n");
-            goto loadinput_cleanup;
+    buffer.data[buffer.count]='\0';
+    input->data=buffer.data;
+    input->length=buffer.count;
+    input->maplength=0;
+    return true;
+}
+
+#ifdef COMMAND_MMAP
+/** Maps a regular file into memory read-only, followed by at least one zero byte so the lexer sees a terminated string.
+ *  @param[in] fd file descriptor
+ *  @param[in] size size of the file in bytes
+ *  @param[out] input filled out with the mapping
+ *  @returns bool indicating success. */
+static bool command_mapinput(int fd, size_t size, commandinput *input) {
+    size_t pagesize = (size_t) sysconf(_SC_PAGESIZE);
+    size_t maplength = (size/pagesize + 1)*pagesize;
+    
+    /* Reserve a zero filled region with room for the terminator... */
+    char *region = mmap(NULL, maplength, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (region==MAP_FAILED) return false;
+    
+    /* ...and map the file over the start of it; the remainder of the final page of the file is also zero filled */
+    if (mmap(region, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0)==MAP_FAILED) {
+        munmap(region, maplength);
+        return false;
+    }
+    
+    madvise(region, size, MADV_SEQUENTIAL);
+    
+    input->data=region;
+    input->length=size;
+    input->maplength=maplength;
+    return true;
+}
+#endif
+
+/** Loads the contents of a file, mapping regular files into memory if requested and possible */
+static bool command_openinput(const char *in, bool map, commandinput *input) {
+    input->data=NULL;
+    input->length=0;
+    input->maplength=0;
+    input->format=COMMAND_TEXT;
+    
+#ifdef COMMAND_MMAP
+    bool mapped = false;
+    if (map) {
+        int fd=open(in, O_RDONLY);
+        if (fd<0) {
+            fprintf(stderr, "morphoview: Couldn't open input file %s.\n", in);
+            return false;
         }
         
-        /* Read in the file */
-        for (char *c=buffer.data; !feof(f); c=c+strlen(c)) {
-            if (!fgets(c, (int) (buffer.data+buffer.capacity-c), f)) { c[0]='\0'; break; }
+        struct stat st;
+        mapped = (fstat(fd, &st)==0 && S_ISREG(st.st_mode) && st.st_size>0 &&
+                  command_mapinput(fd, (size_t) st.st_size, input));
+        
+        close(fd); /* The mapping remains valid once the file is closed */
+    }
+    if (!mapped)
+#endif
+    {
+        FILE *f=fopen(in, "rb");
+        if (!f) {
+            fprintf(stderr, "morphoview: Couldn't open input file %s.\n", in);
+            return false;
         }
+        
+        bool success=command_readinput(f, input);
+        fclose(f);
+        if (!success) return false;
     }
-    *out = buffer.data;
-    fclose(f);
+    
+    /* Identify the format from the magic number */
+    input->format=(mvb_identify(input->data, input->length) ? COMMAND_BINARY : COMMAND_TEXT);
+    
     return true;
+}
+
+/** Loads the contents of a file. Regular files are mapped into memory where possible; pipes and other streams are read into a buffer.
+ *  @param[in] in file name
+ *  @param[out] input filled out with the contents of the file, terminated by '\0'. Call command_freeinput on this once done.
+ *  @returns bool indicating success. */
+bool command_loadinput(const char *in, commandinput *input) {
+    return command_openinput(in, true, input);
+}
+
+/** Loads the contents of a file into a buffer without mapping it, for files that may be rewritten while they are
+ *  parsed; truncating a mapped file would fault the parser.
+ *  @param[in] in file name
+ *  @param[out] input filled out as for command_loadinput
+ *  @returns bool indicating success. */
+bool command_readfile(const char *in, commandinput *input) {
+    return command_openinput(in, false, input);
+}
+
+/** Frees the contents of a file loaded with command_loadinput
+ *  @param[in] input the input to free */
+void command_freeinput(commandinput *input) {
+    if (!input->data) return;
+#ifdef COMMAND_MMAP
+    if (input->maplength) munmap(input->data, input->maplength);
+    else
+#endif
+    MORPHO_FREE(input->data);
     
-loadinput_cleanup:
-    if (f) fclose(f);
-    varray_charclear(&buffer);
-    return false;
+    input->data=NULL;
+    input->length=0;
+    input->maplength=0;
 }
 
 /* -------------------------------------------------------
@@ -130,6 +251,7 @@ static char command_lexpeek(lexer *l) {
 void command_lexinit(lexer *l, const char *start) {
     l->start=start;
     l->current=start;
+    l->index=NULL;
 }
 
 /** @brief Lex numbers
@@ -139,9 +261,7 @@ void command_lexinit(lexer *l, const char *start) {
 static bool command_lexnumber(lexer *l, token *tok) {
     tokentype type=TOKEN_INTEGER;
     
-    /* Handle initial negative sign */
-    if (command_lexpeek(l) == '-') command_lexadvance(l);
-    
+    /* The initial digit or negative sign has already been consumed by command_lex */
     while (command_lexisdigit(command_lexpeek(l))) command_lexadvance(l);
     
     /* Fractional part */
@@ -187,9 +307,63 @@ static bool command_lexstring(lexer *l, token *tok) {
     return true;
 }
 
+/** @brief Skips white space, returning a pointer to the next character that isn't */
+static const char *command_lexskipspace(const char *c) {
+    while (*c==' ' || *c=='\n' || *c=='\t' || *c=='\r' || *c=='\v' || *c=='\f') c++;
+    return c;
+}
+
+/** @brief Finds the end of a number, following the same rules as command_lexnumber but as a tight loop over characters
+ *  @param[in]  c        start of the number; must be a digit or '-'
+ *  @param[out] isfloat  whether the number is a float
+ *  @returns pointer to the character following the number */
+static const char *command_lexscannumber(const char *c, bool *isfloat) {
+    *isfloat=false;
+    
+    if (*c=='-') c++;
+    while (command_lexisdigit(*c)) c++;
+    
+    if (*c=='.') { /* Fractional part */
+        *isfloat=true;
+        c++;
+        while (command_lexisdigit(*c)) c++;
+    }
+    
+    if (*c=='e' || *c=='E') { /* Exponent */
+        *isfloat=true;
+        c++;
+        if (*c=='+' || *c=='-') c++;
+        while (command_lexisdigit(*c)) c++;
+    }
+    
+    return c;
+}
+
+/** @brief Counts a run of numbers without advancing the lexer
+ *  @param[in]  c         where to start counting
+ *  @param[in]  integers  only count integers
+ *  @param[out] end       start of the token following the run
+ *  @returns the number of consecutive numbers */
+static int command_lexcountnumbers(const char *c, bool integers, const char **end) {
+    int count=0;
+    bool isfloat;
+    *end=c;
+    
+    for (c=command_lexskipspace(c); *c=='-' || command_lexisdigit(*c); c=command_lexskipspace(c)) {
+        c=command_lexscannumber(c, &isfloat);
+        if (integers && isfloat) break;
+        *end=c;
+        count++;
+    }
+    
+    *end=command_lexskipspace(*end);
+    return count;
+}
+
 /** @brief Obtain the next token */
 bool command_lex(lexer *l, token *tok) {
     /** Skip leading white space */
+    if (l->index && isspace(command_lexpeek(l))) l->current=structural_skipspace(l->index, l->current);
     while (isspace(command_lexpeek(l))) command_lexadvance(l);
     
     l->start = l->current;
@@ -221,12 +395,134 @@ bool command_lex(lexer *l, token *tok) {
         case 'T': command_lexrecordtoken(l, TOKEN_TEXT, tok); return true;
         case 'v': command_lexrecordtoken(l, TOKEN_VERTICES, tok); return true;
         case 'W': command_lexrecordtoken(l, TOKEN_WINDOW, tok); return true;
+        case 'M': command_lexrecordtoken(l, TOKEN_SHARED, tok); return true;
+        case 'R': command_lexrecordtoken(l, TOKEN_REPLACE, tok); return true;
+        case 'A': command_lexrecordtoken(l, TOKEN_ATTRIBUTE, tok); return true;
+        case 'D': command_lexrecordtoken(l, TOKEN_DELETE, tok); return true;
+        case 'E': command_lexrecordtoken(l, TOKEN_ERASE, tok); return true;
+        case 'U': command_lexrecordtoken(l, TOKEN_UPDATE, tok); return true;
         case '"': return command_lexstring(l, tok);
     }
     
     return false;
 }
 
+/* -------------------------------------------------------
+ * Jobs
+ * ------------------------------------------------------- */
+
+DEFINE_VARRAY(commandjob, commandjob);
+
+/** Number of threads used to convert runs of numbers; 0 selects one per processor */
+static int command_threads = 0;
+
+/** Sets the number of threads used to convert runs of numbers
+ *  @param[in] n - number of threads; 1 converts runs as they are parsed, 0 uses one per processor */
+void command_setthreads(int n) {
+    command_threads = (n>0 ? n : 0);
+}
+
+/** Gets the number of threads to use */
+static int command_getthreads(void) {
+    int n = command_threads;
+#ifdef COMMAND_THREADS
+    if (n==0) n = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n<1) n=1;
+    return (n<COMMAND_MAXTHREADS ? n : COMMAND_MAXTHREADS);
+}
+
+/** Converts a run of white space separated numbers
+ *  @param[in] c - start of the run
+ *  @param[in] end - start of the token following the run
+ *  @param[in] count - number of numbers in the run
+ *  @param[out] fout - storage for floats, or NULL
+ *  @param[out] iout - storage for integers, or NULL
+ *  @returns true if the run held exactly count numbers */
+static bool command_convertrun(const char *c, const char *end, int count, float *fout, int *iout) {
+    for (int i=0; i<count; i++) {
+        c=command_lexskipspace(c);
+        if (!(*c=='-' || command_lexisdigit(*c))) return false;
+        c=(fout ? numeric_scanfloat(c, end, fout+i) : numeric_scaninteger(c, end, iout+i));
+    }
+    
+    return (command_lexskipspace(c)==end);
+}
+
+/** @brief Queue of jobs shared between worker threads */
+typedef struct {
+    varray_commandjob *jobs;
+    int next; /** Next job to claim */
+    bool success;
+#ifdef COMMAND_THREADS
+    pthread_mutex_t lock;
+#endif
+} commandqueue;
+
+/** Converts jobs from the queue until none remain */
+static void *command_worker(void *arg) {
+    commandqueue *q = (commandqueue *) arg;
+    
+    for (;;) {
+#ifdef COMMAND_THREADS
+        pthread_mutex_lock(&q->lock);
+#endif
+        int i = q->next++;
+#ifdef COMMAND_THREADS
+        pthread_mutex_unlock(&q->lock);
+#endif
+        if (i>=q->jobs->count) break;
+        
+        /* Storage is located only now, as the scene's arrays may have moved since the job was recorded */
+        commandjob *job = &q->jobs->data[i];
+        float *fout = (job->integers ? NULL : job->scene->data.data+job->indx);
+        int *iout = (job->integers ? job->scene->indx.data+job->indx : NULL);
+        
+        if (!command_convertrun(job->start, job->end, job->count, fout, iout)) {
+#ifdef COMMAND_THREADS
+            pthread_mutex_lock(&q->lock);
+#endif
+            q->success=false;
+#ifdef COMMAND_THREADS
+            pthread_mutex_unlock(&q->lock);
+#endif
+        }
+    }
+    
+    return NULL;
+}
+
+/** Converts all outstanding jobs, using worker threads where available, and empties the list
+ *  @param[in] jobs - list of jobs
+ *  @returns true on success */
+static bool command_runjobs(varray_commandjob *jobs) {
+    if (jobs->count==0) return true;
+    
+    commandqueue q = { .jobs = jobs, .next = 0, .success = true };
+    
+#ifdef COMMAND_THREADS
+    pthread_t threads[COMMAND_MAXTHREADS];
+    int nthreads = command_getthreads();
+    if (nthreads>jobs->count) nthreads=jobs->count;
+    
+    /* The calling thread works alongside the others */
+    int started=0;
+    pthread_mutex_init(&q.lock, NULL);
+    while (started<nthreads-1 && pthread_create(&threads[started], NULL, command_worker, &q)==0) started++;
+#endif
+    
+    command_worker(&q);
+    
+#ifdef COMMAND_THREADS
+    for (int i=0; i<started; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&q.lock);
+#endif
+    
+    jobs->count=0;
+    if (!q.success) fprintf(stderr, "morphoview: Malformed numerical data.\n");
+    return q.success;
+}
+
 /* -------------------------------------------------------
  * Parser
  * ------------------------------------------------------- */
@@ -236,7 +532,13 @@ void command_parseinit(parser *p, char *in) {
     command_lexinit(&p->l, in);
     p->current.type=TOKEN_NONE;
     p->prev.type=TOKEN_NONE;
+    p->scene=NULL;
+    p->sink=NULL;
+    p->view=NULL;
+    p->cobject=NULL;
+    mat3d_identity4x4(p->model);
     p->modelchanged=false;
+    p->jobs=NULL;
 }
 
 /** Advance the parser one token */
@@ -254,19 +556,30 @@ bool command_parseadvance(parser *p) {
 
 /** Parses the current token as an integer */
 bool command_parseinteger(parser *p, int *out) {
-    if (p->current.type==TOKEN_INTEGER) {
-        long f = strtol(p->current.start, NULL, 10);
-        *out = (int) f;
+    if (p->current.type==TOKEN_INTEGER &&
+        numeric_parseinteger(p->current.start, p->current.length, out)) {
         return command_parseadvance(p);
     }
     return false;
 }
 
+/** Parses the current token as a size, such as a byte offset, which may exceed the range of an integer */
+bool command_parsesize(parser *p, size_t *out) {
+    if (p->current.type==TOKEN_INTEGER && p->current.start[0]!='-') {
+        char *end;
+        unsigned long long value = strtoull(p->current.start, &end, 10);
+        if (end==p->current.start+p->current.length && value<=SIZE_MAX) {
+            *out=(size_t) value;
+            return command_parseadvance(p);
+        }
+    }
+    return false;
+}
+
 /** Parses the current token as a float */
 bool command_parsefloat(parser *p, float *out) {
-    if (p->current.type==TOKEN_INTEGER || p->current.type==TOKEN_FLOAT) {
-        float f = strtof(p->current.start, NULL);
-        *out = f;
+    if ((p->current.type==TOKEN_INTEGER || p->current.type==TOKEN_FLOAT) &&
+        numeric_parsefloat(p->current.start, p->current.length, out)) {
         return command_parseadvance(p);
     }
     return false;
@@ -288,6 +601,19 @@ bool command_parsestring(parser *p, char **out) {
     return false;
 }
 
+/** Parses the current token as a string held by the scene being built, so that it is freed with the scene */
+bool command_parsescenestring(parser *p, char **out) {
+    if (p->current.type==TOKEN_INTEGER || p->current.type==TOKEN_STRING) {
+        char *str = scene_addstring(p->scene, p->current.start+1, p->current.length-2);
+        if (str) {
+            *out = str;
+            
+            return command_parseadvance(p);
+        }
+    }
+    return false;
+}
+
 /** Checks the current token type */
 tokentype command_parsecurrenttype(parser *p) {
     return p->current.type;
@@ -299,6 +625,136 @@ bool command_iscurrentnumerical(parser *p) {
     return (t==TOKEN_FLOAT || t==TOKEN_INTEGER);
 }
 
+/** Counts the run of numbers starting with the current token, without advancing the parser
+ *  @param[in] p - the parser
+ *  @param[in] integers - only count integers
+ *  @param[in] exact - count character by character rather than using the structural index
+ *  @param[out] end - start of the token following the run
+ *  @returns the length of the run */
+int command_countnumerical(parser *p, bool integers, bool exact, const char **end) {
+    tokentype t=command_parsecurrenttype(p);
+    *end=p->current.start;
+    if (!(t==TOKEN_INTEGER || (!integers && t==TOKEN_FLOAT))) return 0;
+    
+    if (!exact && p->l.index) {
+        int count=structural_countrun(p->l.index, p->current.start, integers, end);
+        if (count>0) return count;
+    }
+    
+    return command_lexcountnumbers(p->current.start, integers, end);
+}
+
+/** Converts a run of numbers previously counted by command_countnumerical, then moves the lexer to the end of it.
+ *  @param[in] p - the parser
+ *  @param[in] count - number of numbers in the run
+ *  @param[in] end - start of the token following the run
+ *  @param[out] fout - storage for floats, or NULL
+ *  @param[out] iout - storage for integers, or NULL
+ *  @returns true on success */
+static bool command_parsenumericalrun(parser *p, int count, const char *end, float *fout, int *iout) {
+    if (!command_convertrun(p->current.start, end, count, fout, iout)) return false;
+    
+    /* Continue lexing from the end of the run */
+    p->l.start=p->l.current=end;
+    return true;
+}
+
+/** Defers conversion of a long run of numbers to a later call to command_runjobs.
+ *  @details The run is counted with the structural index in segments of about COMMAND_JOBSIZE characters, each of
+ *           which becomes a job, and storage for the whole run is reserved at once. Short runs, and runs the index
+ *           can't count exactly, are left to be converted as they are parsed.
+ *  @param[in] p - the parser
+ *  @param[in] integers - whether the run consists of integers
+ *  @param[out] count - number of numbers in the run
+ *  @param[out] indx - index of the first number in the scene's data or index array
+ *  @returns true if the run was deferred, in which case the lexer is moved to the end of it */
+static bool command_parsedefer(parser *p, bool integers, int *count, int *indx) {
+    if (!p->jobs || !p->l.index || !p->scene) return false;
+    
+    int first=p->jobs->count, total=0;
+    const char *c=p->current.start, *end=c;
+    bool more;
+    
+    do {
+        int n=structural_countsegment(p->l.index, c, integers, COMMAND_JOBSIZE, &end, &more);
+        
+        if (n<=0 || (!more && first==p->jobs->count && end-c<COMMAND_JOBMIN)) {
+            p->jobs->count=first;
+            return false;
+        }
+        
+        commandjob job = { .scene = p->scene, .start = c, .end = end, .count = n, .indx = total, .integers = integers };
+        if (!varray_commandjobadd(p->jobs, &job, 1)) {
+            p->jobs->count=first;
+            return false;
+        }
+        
+        total+=n;
+        c=end;
+    } while (more);
+    
+    void *storage = (integers ? (void *) scene_reserveindex(p->scene, total, indx) : (void *) scene_reservedata(p->scene, total, indx));
+    if (!storage) {
+        p->jobs->count=first;
+        return false;
+    }
+    
+    for (int i=first; i<p->jobs->count; i++) p->jobs->data[i].indx+=*indx;
+    
+    *count=total;
+    p->l.start=p->l.current=end;
+    return true;
+}
+
+/** Parses a run of floats, appending them to the scene's data array
+ *  @details The run is first counted with the structural index; if the numbers found don't match, the storage is
+ *           released and the run counted again character by character. Long runs may be deferred to be converted
+ *           on worker threads, in which case the storage is filled out by command_runjobs.
+ *  @param[in] p - the parser
+ *  @param[out] count - number of floats read
+ *  @param[out] indx - index of the first float in the scene's data array
+ *  @returns true on success */
+bool command_parsefloats(parser *p, int *count, int *indx) {
+    const char *end;
+    
+    if (command_iscurrentnumerical(p) && command_parsedefer(p, false, count, indx)) return command_parseadvance(p);
+    
+    for (int exact=0; exact<2; exact++) {
+        *count=command_countnumerical(p, false, exact, &end);
+        if (*count==0) return true;
+        
+        float *f=scene_reservedata(p->scene, *count, indx);
+        if (!f) return false;
+        if (command_parsenumericalrun(p, *count, end, f, NULL)) return command_parseadvance(p);
+        scene_releasedata(p->scene, *indx);
+    }
+    
+    return false;
+}
+
+/** Parses a run of integers, appending them to the scene's index array
+ *  @param[in] p - the parser
+ *  @param[out] count - number of integers read
+ *  @param[out] indx - index of the first integer in the scene's index array
+ *  @returns true on success */
+bool command_parseintegers(parser *p, int *count, int *indx) {
+    const char *end;
+    
+    if (command_parsecurrenttype(p)==TOKEN_INTEGER && command_parsedefer(p, true, count, indx)) return command_parseadvance(p);
+    
+    for (int exact=0; exact<2; exact++) {
+        *count=command_countnumerical(p, true, exact, &end);
+        if (*count==0) return true;
+        
+        int *i=scene_reserveindex(p->scene, *count, indx);
+        if (!i) return false;
+        if (command_parsenumericalrun(p, *count, end, NULL, i)) return command_parseadvance(p);
+        scene_releaseindex(p->scene, *indx);
+    }
+    
+    return false;
+}
+
 /* ---------------
  * Parse functions
  * --------------- */
@@ -315,23 +771,30 @@ bool command_parsecolor(parser *p) {
     printf("Color %i ", id);
 #endif
     
-    while (command_iscurrentnumerical(p)) {
-        float r[3];
-        for (int i=0; i<3; i++) ERRCHK(command_parsefloat(p, &r[i]));
-        
-        /* Add to the scene's data array */
-        int ret=scene_adddata(p->scene, r, 3);
-        if (indx<0) indx=ret;
-        
-        length++;
+    /* Parse the whole block into the end of the scene's data array, then move it to the color array */
+    int count;
+    ERRCHK(command_parsefloats(p, &count, &indx));
+    
+    /* The colors must be converted before they are copied and their place in the data array released */
+    if (p->jobs) ERRCHK(command_runjobs(p->jobs));
+    
+    if (count%3!=0) {
+        scene_releasedata(p->scene, indx);
+        fprintf(stderr, "morphoview: Incomplete color definition.\n");
+        return false;
+    }
+    
+    if (count>0) {
+        length=count/3;
         
 #ifdef DEBUG_PARSER
-        printf("%f %f %f ", r[0], r[1], r[2]);
+        for (int i=0; i<count; i++) printf("%f ", p->scene->data.data[indx+i]);
 #endif
     }
     
     if (length>0) {
-        scene_addcolor(p->scene, id, length, indx);
+        scene_addcolor(p->scene, id, p->scene->data.data+indx, length);
+        scene_releasedata(p->scene, indx);
     }
     
 #ifdef DEBUG_PARSER
@@ -364,7 +827,7 @@ bool command_parsedraw(parser *p) {
 #endif
     
     if (p->modelchanged) {
-        indx=scene_adddata(p->scene, p->model, 16);
+        indx=scene_addmatrix(p->scene, p->model);
         p->modelchanged=false;
 #ifdef DEBUG_PARSER
         mat3d_print4x4(p->model);
@@ -402,28 +865,30 @@ bool command_parsevertices(parser *p) {
     }
     
     char *format=NULL;
-    if (command_parsestring(p, &format)) {
+    if (command_parsescenestring(p, &format)) {
 #ifdef DEBUG_PARSER
         printf("Vertices '%s'\n", format);
 #endif
         p->cobject->vertexdata.format=format;
     }
     
-    while (command_iscurrentnumerical(p)) {
-        float f;
-        ERRCHK(command_parsefloat(p, &f));
-        
-        /* Add to the scene's vertex data array */
-        int ret=scene_adddata(p->scene, &f, 1);
+    /* Add the whole block to the scene's vertex data array at once */
+    int count, indx;
+    ERRCHK(command_parsefloats(p, &count, &indx));
+    if (count>0) {
+        if (p->cobject->vertexdata.shared) {
+            fprintf(stderr, "morphoview: Object %i already has vertex data in shared memory.\n", p->cobject->id);
+            return false;
+        }
         
         if (p->cobject->vertexdata.indx==SCENE_EMPTY) {
-            p->cobject->vertexdata.indx=ret;
+            p->cobject->vertexdata.indx=indx;
             p->cobject->vertexdata.length=0;
         }
-        p->cobject->vertexdata.length++;
+        p->cobject->vertexdata.length+=count;
         
 #ifdef DEBUG_PARSER
-        printf("%f ", f);
+        for (int i=0; i<count; i++) printf("%f ", p->scene->data.data[indx+i]);
 #endif
     }
     
@@ -454,26 +919,21 @@ bool command_parseindex(parser *p) {
     printf("Indexed list type %u\n", el.type);
 #endif
     
-    while (command_parsecurrenttype(p)==TOKEN_INTEGER) {
-        int i;
-        ERRCHK(command_parseinteger(p, &i));
+    /* Add the whole block to the scene's index data array at once */
+    int count;
+    ERRCHK(command_parseintegers(p, &count, &el.indx));
+    if (count>0) {
+        el.length=count;
         
 #ifdef DEBUG_PARSER
-        printf("%i ", i);
+        for (int k=0; k<count; k++) printf("%i ", p->scene->indx.data[el.indx+k]);
 #endif
-        
-        /* Add to the scene's index data array */
-        int ret=scene_addindex(p->scene, &i, 1);
-        
-        /* And remember the starting point and length */
-        if (el.indx==SCENE_EMPTY) el.indx=ret;
-        el.length++;
     }
 #ifdef DEBUG_PARSER
     printf("\n");
 #endif
     
-    scene_addelement(p->cobject, &el);
+    ERRCHK(scene_addelement(p->scene, p->cobject, &el)>=0);
     
     return true;
 }
@@ -565,8 +1025,13 @@ bool command_parsescene(parser *p) {
     printf("Scene id: %i dim: %i\n", id, dim);
 #endif
     
+    /* Finish preparing the previous scene */
+    if (p->jobs) ERRCHK(command_runjobs(p->jobs));
+    if (p->scene && scene_sinkisopen(p->sink, p->view)) scene_sinkprepare(p->sink, p->view, p->scene);
+    
     p->scene = scene_new(id, dim);
-    if (p->scene) p->display=display_open(p->scene);
+    p->cobject = NULL; /* The sink may free the previous scene */
+    if (p->scene) p->view=scene_sinkopen(p->sink, p->scene);
     
     return (p->scene!=NULL);
 }
@@ -580,7 +1045,7 @@ bool command_parsewindow(parser *p) {
         printf("Window '%s'\n", name);
 #endif
         if (name) {
-            display_setwindowtitle(p->display, name);
+            scene_sinksettitle(p->sink, p->view, name);
             free(name);
         }
         return true;
@@ -603,7 +1068,9 @@ bool command_parsefont(parser *p) {
     printf("Font %i '%s' %g\n", id, file, size);
 #endif
     
-    return scene_addfont(p->scene, id, file, size, NULL);
+    bool success=scene_addfont(p->scene, id, file, size, NULL);
+    free(file);
+    return success;
 }
 
 /** Parses a text command */
@@ -612,7 +1079,7 @@ bool command_parsetext(parser *p) {
     char *string;
     
     ERRCHK(command_parseinteger(p, &fontid));
-    ERRCHK(command_parsestring(p, &string));
+    ERRCHK(command_parsescenestring(p, &string));
     
 #ifdef DEBUG_PARSER
     printf("Text %i '%s'\n", fontid, string);
@@ -622,7 +1089,7 @@ bool command_parsetext(parser *p) {
     int tid=scene_addtext(p->scene, fontid, string);
     
     if (p->modelchanged) {
-        matindx=scene_adddata(p->scene, p->model, 16);
+        matindx=scene_addmatrix(p->scene, p->model);
         p->modelchanged=false;
 #ifdef DEBUG_PARSER
         mat3d_print4x4(p->model);
@@ -634,6 +1101,164 @@ bool command_parsetext(parser *p) {
     return true;
 }
 
+/** Parses a reference to vertex or index data held in shared memory: M "segment" offset count "format"
+ *  @details The offset is in bytes and the count is the number of floats or integers; the format is either a vertex
+ *  format, as for v, or one of "p", "l" or "f" for a list of indices. The data is used in place rather than copied
+ *  into the scene. */
+bool command_parseshared(parser *p) {
+    if (!p->scene || !p->cobject) {
+        fprintf(stderr, "morphoview: No object defined.\n");
+        return false;
+    }
+    
+    char *name=NULL, *format=NULL;
+    size_t offset;
+    int count;
+    
+    bool success=(command_parsestring(p, &name) &&
+                  command_parsesize(p, &offset) &&
+                  command_parseinteger(p, &count) &&
+                  command_parsestring(p, &format));
+    
+#ifdef DEBUG_PARSER
+    if (success) printf("Shared '%s' %zu %i '%s'\n", name, offset, count, format);
+#endif
+    
+    if (success) success=scene_addshared(p->scene, p->cobject, name, offset, count, format);
+    
+    free(name);
+    free(format);
+    return success;
+}
+
+/* ---------------
+ * Update commands
+ * --------------- */
+
+/** Checks that a scene has been defined for an update command */
+static bool command_parsehasscene(parser *p) {
+    if (!p->scene) fprintf(stderr, "morphoview: No scene defined.\n");
+    return (p->scene!=NULL);
+}
+
+/** Finds an object in the current scene for an update command */
+static gobject *command_parsefindobject(parser *p, int id) {
+    gobject *obj = (p->scene ? scene_getgobjectfromid(p->scene, id) : NULL);
+    if (!obj) fprintf(stderr, "morphoview: Object %i not found.\n", id);
+    return obj;
+}
+
+/** Parses a replacement of an object's vertex data: R id floats
+ *  @details The vertices keep the object's format. Where their number is unchanged they are written over the old
+ *  ones, so that a displayed scene only uploads them again. */
+bool command_parsereplace(parser *p) {
+    int id, count, indx;
+    ERRCHK(command_parseinteger(p, &id));
+    ERRCHK(command_parsehasscene(p));
+    ERRCHK(command_parsefloats(p, &count, &indx));
+    
+#ifdef DEBUG_PARSER
+    printf("Replace %i (%i)\n", id, count);
+#endif
+    
+    /* The new vertices must be converted before they are copied */
+    if (p->jobs) ERRCHK(command_runjobs(p->jobs));
+    
+    gobject *obj=command_parsefindobject(p, id);
+    if (!obj) {
+        if (count>0) scene_releasedata(p->scene, indx);
+        return false;
+    }
+    
+    return scene_replacevertices(p->scene, obj, indx, count);
+}
+
+/** Parses a replacement of one attribute of an object's vertices, e.g. only their colors: A id "c" floats */
+bool command_parseattribute(parser *p) {
+    int id, count, indx;
+    char *attribute=NULL;
+    ERRCHK(command_parseinteger(p, &id));
+    ERRCHK(command_parsestring(p, &attribute));
+    
+    bool success=(command_parsehasscene(p) && command_parsefloats(p, &count, &indx));
+    if (success && p->jobs) success=command_runjobs(p->jobs);
+    
+#ifdef DEBUG_PARSER
+    if (success) printf("Attribute %i '%s' (%i)\n", id, attribute, count);
+#endif
+    
+    if (success) {
+        gobject *obj=command_parsefindobject(p, id);
+        
+        if (!obj || strlen(attribute)!=1) {
+            if (obj) fprintf(stderr, "morphoview: Expected a single attribute for object %i.\n", id);
+            if (count>0) scene_releasedata(p->scene, indx);
+            success=false;
+        } else if (count>0) {
+            success=scene_replaceattribute(p->scene, obj, attribute[0], indx, count);
+        }
+    }
+    
+    free(attribute);
+    return success;
+}
+
+/** Parses a deletion of an object together with its draw entries: D id */
+bool command_parsedelete(parser *p) {
+    int id;
+    ERRCHK(command_parseinteger(p, &id));
+#ifdef DEBUG_PARSER
+    printf("Delete %i\n", id);
+#endif
+    
+    ERRCHK(command_parsefindobject(p, id));
+    
+    /* Objects after the deleted one move, so the current object is found again */
+    int cid = (p->cobject ? p->cobject->id : id);
+    scene_removeobject(p->scene, id);
+    p->cobject = (cid!=id ? scene_getgobjectfromid(p->scene, cid) : NULL);
+    
+    /* The entry the next draw would inherit its matrix from may have gone */
+    p->modelchanged=true;
+    
+    return true;
+}
+
+/** Parses an erasure of an object's draw entries, keeping the object so that it may be drawn again: E id */
+bool command_parseerase(parser *p) {
+    int id;
+    ERRCHK(command_parseinteger(p, &id));
+#ifdef DEBUG_PARSER
+    printf("Erase %i\n", id);
+#endif
+    
+    ERRCHK(command_parsefindobject(p, id));
+    scene_removedraws(p->scene, id);
+    
+    /* The entry the next draw would inherit its matrix from may have gone */
+    p->modelchanged=true;
+    
+    return true;
+}
+
+/** Parses an update of the model matrix with which an object is drawn to the current transformation: U id */
+bool command_parseupdate(parser *p) {
+    int id;
+    ERRCHK(command_parseinteger(p, &id));
+#ifdef DEBUG_PARSER
+    printf("Update %i\n", id);
+    mat3d_print4x4(p->model);
+#endif
+    
+    ERRCHK(command_parsefindobject(p, id));
+    if (scene_settransform(p->scene, id, p->model)==0) {
+        fprintf(stderr, "morphoview: Object %i isn't drawn.\n", id);
+        return false;
+    }
+    
+    return true;
+}
+
 #define UNDEFINED NULL
 /** The parse table defines which function handles which token type */
 parsefunction parsetable[] = {
@@ -662,40 +1287,351 @@ parsefunction parsetable[] = {
     command_parsewindow,    // TOKEN_WINDOW
     command_parsefont,      // TOKEN_FONT
     command_parsetext,      // TOKEN_TEXT
+    command_parseshared,    // TOKEN_SHARED
+    command_parsereplace,   // TOKEN_REPLACE
+    command_parseattribute, // TOKEN_ATTRIBUTE
+    command_parsedelete,    // TOKEN_DELETE
+    command_parseerase,     // TOKEN_ERASE
+    command_parseupdate,    // TOKEN_UPDATE
     
     UNDEFINED, // TOKEN_EOF
 };
 
-/** @brief Parses a command sequence */
-bool command_parse(char *in) {
-    parser p;
-    
-    command_parseinit(&p, in);
-    ERRCHK(command_parseadvance(&p));
+/** @brief Parses commands until the end of the input */
+static bool command_parsecommands(parser *p) {
+    ERRCHK(command_parseadvance(p));
+    if (p->current.type==TOKEN_EOF) return true;
     
     do {
         /* Lookup the current parse function */
-        if (p.current.type>TOKEN_EOF) {
+        if (p->current.type>TOKEN_EOF) {
             fprintf(stderr, "morphoview: Inconsistent token definitions.\n");
             return false;
         }
         
-        parsefunction fn = parsetable[p.current.type];
+        parsefunction fn = parsetable[p->current.type];
         if (fn==UNDEFINED) {
             fprintf(stderr, "morphoview: Couldn't parse token.\n");
             return false;
         }
         
-        ERRCHK(command_parseadvance(&p));
+        ERRCHK(command_parseadvance(p));
         
-        bool result = (*fn) (&p);
+        bool result = (*fn) (p);
         if (!result) return false;
-    } while (!command_parseisatend(&p));
+    } while (!command_parseisatend(p));
+    
+    return true;
+}
+
+/** @brief Parses a command sequence
+ *  @param[in] in - the commands, terminated by '\0'
+ *  @param[in] sink - receives the scenes, or NULL
+ *  @returns true on success */
+bool command_parse(char *in, scenesink *sink) {
+    parser p;
+    
+    command_parseinit(&p, in);
+    p.sink=sink;
+    
+    /* Index the input so that the lexer can skip over white space and runs of numbers can be counted quickly */
+    structuralindex *index = malloc(sizeof(structuralindex));
+    if (index) {
+        structural_init(index, in, strlen(in));
+        p.l.index=index;
+    }
+    
+    /* Long runs of numbers are converted on worker threads once the commands around them have been parsed */
+    varray_commandjob jobs;
+    varray_commandjobinit(&jobs);
+    if (command_getthreads()>1) p.jobs=&jobs;
+    
+    bool success=(command_parsecommands(&p) && command_runjobs(&jobs));
+    varray_commandjobclear(&jobs);
+    free(index);
+    if (!success) return false;
     
     /** Prepare the scene for display */
-    if (p.scene && p.display) {
-        render_preparescene(&p.display->render, p.scene);
+    if (p.scene) scene_sinkprepare(p.sink, p.view, p.scene);
+    
+    return true;
+}
+
+/** @brief Parses the contents of a file loaded with command_loadinput, according to its format */
+bool command_parseinput(commandinput *input, scenesink *sink) {
+    if (input->format==COMMAND_BINARY) return mvb_parse(input->data, input->length, sink);
+    return command_parse(input->data, sink);
+}
+
+/* -------------------------------------------------------
+ * Streams
+ * ------------------------------------------------------- */
+
+/** @brief Initializes a stream parser
+ *  @param[in] s - the stream parser
+ *  @param[in] sink - receives the scenes, or NULL */
+void command_streaminit(commandstream *s, scenesink *sink) {
+    command_parseinit(&s->p, NULL);
+    s->p.sink=sink;
+    varray_charinit(&s->buffer);
+    s->scanned=0;
+    s->boundary=0;
+    s->instring=false;
+    s->prevspace=true;
+    s->identified=false;
+    s->format=COMMAND_TEXT;
+    s->published=0;
+    s->index=malloc(sizeof(structuralindex));
+}
+
+/** @brief Frees data held by a stream parser */
+void command_streamclear(commandstream *s) {
+    varray_charclear(&s->buffer);
+    free(s->index);
+    s->index=NULL;
+}
+
+/** @brief Checks if a character is a command */
+static bool command_iscommand(char c) {
+    switch (c) {
+        case 'c': case 'C': case 'd': case 'o': case 'p': case 'l': case 'f': case 'F':
+        case 'i': case 'm': case 'r': case 's': case 'S': case 't': case 'T': case 'v': case 'W': case 'M':
+        case 'R': case 'A': case 'D': case 'E': case 'U':
+            return true;
+    }
+    return false;
+}
+
+/** @brief Checks whether a word of 8 characters can't contain a command or quote, i.e. every byte lacks bit 6 and isn't '"' */
+static bool command_streamskippable(const char *c) {
+    uint64_t w, q;
+    memcpy(&w, c, sizeof(uint64_t));
+    q = w ^ 0x2222222222222222ULL;
+    
+    return !((w & 0x4040404040404040ULL) ||
+             ((q - 0x0101010101010101ULL) & ~q & 0x8080808080808080ULL));
+}
+
+/** @brief Scans newly arrived input for the start of commands, recording the last one found */
+static void command_streamscan(commandstream *s) {
+    size_t count = s->buffer.count;
+    
+    for (size_t i=s->scanned; i<count; i++) {
+        /* Runs of numbers contain no letters other than exponents, so can be skipped a word at a time */
+        if (!s->instring && i+sizeof(uint64_t)<=count && command_streamskippable(s->buffer.data+i)) {
+            do i+=sizeof(uint64_t);
+            while (i+sizeof(uint64_t)<=count && command_streamskippable(s->buffer.data+i));
+            
+            s->prevspace=isspace(s->buffer.data[i-1]);
+            if (i>=count) break;
+        }
+        
+        char c = s->buffer.data[i];
+        
+        if (s->instring) {
+            if (c=='"') s->instring=false;
+        } else if (c=='"') {
+            s->instring=true;
+        } else if (s->prevspace && command_iscommand(c)) {
+            s->boundary=i;
+        }
+        
+        s->prevspace=(!s->instring && isspace(c));
+    }
+    s->scanned=count;
+}
+
+/** @brief Parses the buffered input up to a given point, then discards it */
+static bool command_streamparseto(commandstream *s, size_t end) {
+    if (end==0) return true;
+    
+    /* Terminate the input temporarily */
+    char *in = s->buffer.data;
+    char c = in[end];
+    in[end]='\0';
+    
+    command_lexinit(&s->p.l, in);
+    if (s->index) {
+        structural_init(s->index, in, end);
+        s->p.l.index=s->index;
+    }
+    
+    bool success=command_parsecommands(&s->p);
+    in[end]=c;
+    
+    memmove(in, in+end, s->buffer.count-end);
+    s->buffer.count-=(int) end;
+    s->scanned-=end;
+    s->boundary=(s->boundary>end ? s->boundary-end : 0);
+    
+    return success;
+}
+
+/** @brief Feeds input to a stream parser, parsing any commands that are complete
+ *  @param[in] s - the stream parser
+ *  @param[in] data - input received
+ *  @param[in] length - length of the input
+ *  @returns true on success */
+bool command_streamfeed(commandstream *s, const char *data, size_t length) {
+    /* Keep room for a terminator after the buffered input */
+    if (!varray_charadd(&s->buffer, (char *) data, (int) length) ||
+        !varray_charresize(&s->buffer, 1)) {
+        fprintf(stderr, "morphoview: Couldn't allocate buffer for input.\n");
+        return false;
+    }
+    
+    /* Identify the format from the magic number */
+    if (!s->identified) {
+        if (s->buffer.count<MVB_MAGICLENGTH) return true;
+        s->format=(memcmp(s->buffer.data, MVB_MAGIC, MVB_MAGICLENGTH)==0 ? COMMAND_BINARY : COMMAND_TEXT);
+        s->identified=true;
     }
     
+    if (s->format==COMMAND_BINARY) return true;
+    
+    command_streamscan(s);
+    ERRCHK(command_streamparseto(s, s->boundary));
+    
+    command_streampublish(s, false);
+    return true;
+}
+
+/** @brief Hands the scene parsed so far to the sink
+ *  @details Preparing the scene for display uploads all of it again, so unless forced this only happens once the scene
+ *           has grown by COMMAND_STREAMGROWTH since it was last handed over; the total work is then proportional to its
+ *           size. Scenes changed in place by update commands are handed over as soon as possible.
+ *  @param[in] s - the stream parser
+ *  @param[in] force - hand over the scene if it has changed at all */
+void command_streampublish(commandstream *s, bool force) {
+    scene *sc = s->p.scene;
+    if (!sc || !scene_sinkisopen(s->p.sink, s->p.view)) return;
+    
+    int size = sc->data.count + sc->indx.count + sc->displaylist.count;
+    
+    /* Edits that don't enlarge the scene are applied in place, so are handed over at once */
+    if (!(sc->edited && size<=s->published)) {
+        if (size==s->published) return;
+        if (!force && size<COMMAND_STREAMGROWTH*s->published) return;
+    }
+    
+    scene_sinkprepare(s->p.sink, s->p.view, sc);
+    s->published=size;
+}
+
+/** @brief Parses the remaining input once the stream has ended
+ *  @returns true on success */
+bool command_streamfinish(commandstream *s) {
+    if (s->format==COMMAND_BINARY) return mvb_parse(s->buffer.data, s->buffer.count, s->p.sink);
+    
+    ERRCHK(command_streamparseto(s, s->buffer.count));
+    command_streampublish(s, true);
     return true;
 }
+
+/** @brief Checks whether a file should be read as a stream: standard input ('-'), pipes and FIFOs */
+bool command_isstream(const char *in) {
+    if (strcmp(in, "-")==0) return true;
+#ifdef COMMAND_MMAP
+    struct stat st;
+    if (stat(in, &st)==0 && !S_ISREG(st.st_mode)) return true;
+#endif
+    return false;
+}
+
+/** @brief Current time in seconds */
+static double command_time(void) {
+    struct timespec t;
+    timespec_get(&t, TIME_UTC);
+    return (double) t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+/** @brief Parses commands from a stream as they arrive, handing scenes to the sink as they grow
+ *  @param[in] in - file name, or '-' for standard input
+ *  @param[in] sink - receives the scenes, or NULL
+ *  @returns true on success */
+bool command_parsestream(const char *in, scenesink *sink) {
+    bool isstdin = (strcmp(in, "-")==0);
+    bool success=true, closed=false;
+    char chunk[COMMAND_READCHUNK];
+    
+#ifdef COMMAND_POLL
+    int fd = (isstdin ? STDIN_FILENO : open(in, O_RDONLY));
+    if (fd<0) {
+#else
+    FILE *f = (isstdin ? stdin : fopen(in, "rb"));
+    if (!f) {
+#endif
+        fprintf(stderr, "morphoview: Couldn't open input file %s.\n", in);
+        return false;
+    }
+    
+    commandstream s;
+    command_streaminit(&s, sink);
+    double lastframe = command_time();
+    
+    for (;;) {
+        bool waiting=false;
+        long n;
+        
+#ifdef COMMAND_POLL
+        /* Wait briefly for input, so that the sink stays responsive */
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, COMMAND_STREAMWAIT);
+        if (ready<0) {
+            n=(errno==EINTR ? 0 : -1);
+            waiting=true;
+        } else if (ready==0) {
+            n=0;
+            waiting=true;
+        } else {
+            n=(long) read(fd, chunk, sizeof(chunk));
+            if (n==0) break; /* End of input */
+            if (n<0 && (errno==EINTR || errno==EAGAIN)) {
+                n=0;
+                waiting=true;
+            }
+        }
+#else
+        n=(long) fread(chunk, sizeof(char), sizeof(chunk), f);
+        if (n==0) {
+            if (!ferror(f)) break; /* End of input */
+            n=-1;
+        }
+#endif
+        
+        if (n<0) {
+            fprintf(stderr, "morphoview: Error reading input file %s.\n", in);
+            success=false;
+            break;
+        }
+        
+        if (waiting) { /* Show whatever has arrived while waiting for more */
+            command_streampublish(&s, true);
+        } else if (!command_streamfeed(&s, chunk, (size_t) n)) {
+            success=false;
+            break;
+        }
+        
+        if (waiting || command_time()-lastframe>=COMMAND_STREAMFRAME) {
+            scene_sinkupdate(sink);
+            lastframe=command_time();
+            
+            /* Stop if the sink has finished with the scene, e.g. as its window was closed, as this frees it */
+            if (s.p.scene && !scene_sinkisopen(sink, s.p.view)) {
+                closed=true;
+                break;
+            }
+        }
+    }
+    
+    if (success && !closed) success=command_streamfinish(&s);
+    
+    command_streamclear(&s);
+#ifdef COMMAND_POLL
+    if (!isstdin) close(fd);
+#else
+    if (!isstdin) fclose(f);
+#endif
+    
+    return success;
+}
@@ -10,11 +10,58 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "scene.h"
-#include "display.h"
 #include "matrix3d.h"
+#include "structural.h"
 
 //#define DEBUG_PARSER
 
+/** Map regular input files into memory rather than reading them, poll streams for input, and convert large runs of
+ *  numbers on worker threads */
+#ifndef _WIN32
+#define COMMAND_MMAP
+#define COMMAND_POLL
+#define COMMAND_THREADS
+#endif
+
+/** Size of chunks used when reading from a pipe */
+#define COMMAND_READCHUNK 65536
+
+/** Time in milliseconds to wait for input from a stream before updating the sink */
+#define COMMAND_STREAMWAIT 10
+
+/** Minimum time in seconds between updates of the sink while a stream is arriving */
+#define COMMAND_STREAMFRAME 0.02
+
+/** Factor by which a scene must grow before it is handed to the sink again while a stream is arriving */
+#define COMMAND_STREAMGROWTH 2
+
+/** Runs of numbers at least this many characters long are deferred for conversion on worker threads */
+#define COMMAND_JOBMIN 65536
+
+/** Longer runs are split into jobs of about this many characters */
+#define COMMAND_JOBSIZE 1048576
+
+/** Maximum number of worker threads */
+#define COMMAND_MAXTHREADS 64
+
+/* -------------------------------------------------------
+ * Input
+ * ------------------------------------------------------- */
+
+/** @brief Formats of input file */
+typedef enum {
+    COMMAND_TEXT, /** The command language */
+    COMMAND_BINARY /** The .mvb binary format; see mvb.h */
+} commandformat;
+
+/** @brief Contents of an input file */
+typedef struct {
+    char *data; /** Contents of the file, terminated by '\0' */
+    size_t length; /** Length of the contents excluding the terminator */
+    size_t maplength; /** Length of the memory mapping, or 0 if the contents were read into a buffer */
+    commandformat format; /** Format of the contents */
+} commandinput;
+
 /* -------------------------------------------------------
  * Tokens
  * ------------------------------------------------------- */
@@ -46,6 +93,12 @@ typedef enum {
     TOKEN_WINDOW,
     TOKEN_FONT,
     TOKEN_TEXT,
+    TOKEN_SHARED,
+    TOKEN_REPLACE,
+    TOKEN_ATTRIBUTE,
+    TOKEN_DELETE,
+    TOKEN_ERASE,
+    TOKEN_UPDATE,
     
     TOKEN_EOF
 } tokentype;
@@ -65,8 +118,25 @@ typedef struct {
 typedef struct {
     const char* start; /** Starting point to lex */
     const char* current; /** Current point */
+    structuralindex *index; /** Structural index of the input, or NULL */
 } lexer;
 
+/* -------------------------------------------------------
+ * Jobs
+ * ------------------------------------------------------- */
+
+/** @brief A run of numbers, counted and allocated by the parser, awaiting conversion */
+typedef struct {
+    scene *scene; /** Scene holding the storage */
+    const char *start; /** Start of the first number */
+    const char *end; /** Start of the token following the run */
+    int count; /** Number of numbers in the run */
+    int indx; /** Index of the first number in the scene's data array, or index array for integers */
+    bool integers; /** Whether the run consists of integers */
+} commandjob;
+
+DECLARE_VARRAY(commandjob, commandjob);
+
 /* -------------------------------------------------------
  * Parser
  * ------------------------------------------------------- */
@@ -78,28 +148,68 @@ typedef struct {
     token prev;
     
     scene *scene;
-    display *display;
+    scenesink *sink; /** Receives scenes as they are created */
+    void *view; /** Handle given by the sink for the current scene */
     
     mat4x4 model; /* The model matrix */
     bool modelchanged;
     
     gobject *cobject;
+    
+    varray_commandjob *jobs; /** Runs awaiting conversion, or NULL to convert runs as they are parsed */
 } parser;
 
 /** @brief Definition of a parse function. */
 typedef bool (*parsefunction) (parser *p);
 
+/* -------------------------------------------------------
+ * Streams
+ * ------------------------------------------------------- */
+
+/** @brief An incremental parser, fed with input as it arrives.
+ *  @details Input is buffered until the start of a following command shows that the commands before it are complete;
+ *  these are then parsed and discarded from the buffer. The parser state carries over from one portion to the next. */
+typedef struct {
+    parser p;
+    varray_char buffer; /** Input not yet parsed */
+    
+    size_t scanned; /** Number of characters in the buffer already scanned for command boundaries */
+    size_t boundary; /** Start of the last command found; the commands before it are complete */
+    bool instring; /** Whether scanning stopped within a string */
+    bool prevspace; /** Whether the last character scanned was white space */
+    
+    bool identified; /** Whether the format of the input is known yet */
+    commandformat format; /** Format of the input; binary input is parsed once complete */
+    
+    int published; /** Size of the scene when last handed to the sink */
+    structuralindex *index;
+} commandstream;
+
 /* -------------------------------------------------------
  * Prototypes
  * ------------------------------------------------------- */
 
 bool command_getfilesize(FILE *f, size_t *s);
-bool command_loadinput(const char *in, char **out);
+bool command_loadinput(const char *in, commandinput *input);
+bool command_readfile(const char *in, commandinput *input);
+void command_freeinput(commandinput *input);
 void command_removefile(const char *in);
 
 void command_lexinit(lexer *l, const char *start);
 bool command_lex(lexer *l, token *tok);
 
-bool command_parse(char *in);
+void command_setthreads(int n);
+
+bool command_parse(char *in, scenesink *sink);
+bool command_parseinput(commandinput *input, scenesink *sink);
+
+void command_streaminit(commandstream *s, scenesink *sink);
+void command_streamclear(commandstream *s);
+bool command_streamfeed(commandstream *s, const char *data, size_t length);
+void command_streampublish(commandstream *s, bool force);
+bool command_streamfinish(commandstream *s);
+
+bool command_isstream(const char *in);
+bool command_parsestream(const char *in, scenesink *sink);
 
 #endif /* command_h */
@@ -15,6 +15,12 @@
 
 display *opendisplays;
 
+/** Whether OpenGL functions have been loaded */
+static bool displayglloaded = false;
+
+/** Whether every display is drawn continuously to measure rendering */
+static bool displayprofiling = false;
+
 /* -------------------------------------------------------
  * Utility functions
  * ------------------------------------------------------- */
@@ -30,10 +36,14 @@ void display_add(display *d) {
     opendisplays=d;
 }
 
-/** Frees data attached to a display */
+/** Frees data attached to a display, and closes its window */
 void display_free(display *d) {
+    if (d->window) {
+        glfwMakeContextCurrent(d->window);
+        render_clear(&d->render);
+        glfwDestroyWindow(d->window);
+    }
     scene_free(d->s);
-    render_clear(&d->render);
     free(d);
 }
 
@@ -50,7 +60,7 @@ void display_remove(display *d) {
                 display_free(d);
                 return;
             }
-            prev=d;
+            prev=e;
         }
     }
 }
@@ -72,12 +82,25 @@ static void display_framebuffersizecallback(windowref *window, int width, int he
     //glViewport(0, 0, width, height);
     d->width = (float) width;
     glViewport(0, 0, width, height);
+    d->dirty=true;
+}
+
+/** Window refresh callback, called when the window's contents have been damaged, e.g. when it is uncovered */
+static void display_refreshcallback(windowref *window) {
+    display_fromwindow(window)->dirty=true;
+}
+
+/** Window iconify callback; windows aren't drawn while iconified, so are drawn again once restored */
+static void display_iconifycallback(windowref *window, int iconified) {
+    if (!iconified) display_fromwindow(window)->dirty=true;
 }
 
 /** Keypress callback function */
 static void display_keycallback(windowref *window, int key, int scancode, int action, int mods) {
     if (action!=GLFW_PRESS) return;
     display *d=display_fromwindow(window);
+    d->dirty=true;
+    if (d->keyfn && d->keyfn(d->keyref, key, mods)) return;
     
     switch (key) {
         case GLFW_KEY_ESCAPE:
@@ -147,21 +170,12 @@ static void display_keycallback(windowref *window, int key, int scancode, int ac
     
 }
 
-/** Mouse click callback */
-static void display_mousebuttoncallback(windowref *window, int button, int action, int mods) {
-    display *d=display_fromwindow(window);
+/** Applies the mouse movement since the view was last changed while dragging. Cursor events are merged this way, so
+ *  that the view changes at most once each time the window is drawn. */
+static void display_applydrag(display *d) {
+    double x=d->cx, y=d->cy;
+    if (d->state==NORMAL || (x==d->ox && y==d->oy)) return;
     
-    if (action == GLFW_PRESS) {
-        d->state = (button==GLFW_MOUSE_BUTTON_LEFT ? DRAGGING_ROT : DRAGGING_TRANS);
-    } else {
-        d->state = NORMAL;
-    }
-}
-
-/** Cursor position callback */
-static void display_cursorposncallback(windowref *window, double x, double y) {
-    display *d=display_fromwindow(window);
-
     if (d->state==DRAGGING_ROT) {
         float dx=2.0*(x-d->ox)/d->width;
         float dy=-2.0*(y-d->oy)/d->width;
@@ -178,11 +192,34 @@ static void display_cursorposncallback(windowref *window, double x, double y) {
     d->ox=x; d->oy=y;
 }
 
+/** Mouse click callback */
+static void display_mousebuttoncallback(windowref *window, int button, int action, int mods) {
+    display *d=display_fromwindow(window);
+    display_applydrag(d);
+    
+    if (action == GLFW_PRESS) {
+        d->state = (button==GLFW_MOUSE_BUTTON_LEFT ? DRAGGING_ROT : DRAGGING_TRANS);
+    } else {
+        d->state = NORMAL;
+    }
+}
+
+/** Cursor position callback */
+static void display_cursorposncallback(windowref *window, double x, double y) {
+    display *d=display_fromwindow(window);
+    
+    d->cx=x; d->cy=y;
+    if (d->state==NORMAL) {
+        d->ox=x; d->oy=y;
+    } else d->dirty=true;
+}
+
 /** Scroll callback */
 static void display_scrollcallback(windowref *window, double x, double y) {
     display *d=display_fromwindow(window);
     
     mat3d_scale(d->view, 1.0-0.25*y, d->view);
+    d->dirty=true;
 }
 
 /* -------------------------------------------------------
@@ -196,8 +233,13 @@ void display_init(display *d, scene *s) {
     d->aspectRatio=1.0;
     d->ox=0.0;
     d->oy=0.0;
+    d->cx=0.0;
+    d->cy=0.0;
     d->state=NORMAL;
     d->window=NULL;
+    d->keyfn=NULL;
+    d->keyref=NULL;
+    d->dirty=true;
     mat3d_identity4x4(d->view);
 }
 
@@ -221,9 +263,13 @@ display *display_open(scene *s) {
 #endif
     glfwWindowHint(GLFW_SAMPLES, 4);
     
-    /* Create a windowed mode window and its OpenGL context */
-    window = glfwCreateWindow(DISPLAY_DEFAULTWIDTH, DISPLAY_DEFAULTHEIGHT, DISPLAY_DEFAULTTITLE, NULL, NULL);
-    if (!window) return NULL;
+    /* Create a windowed mode window and its OpenGL context, which shares objects such as shaders with any others */
+    windowref *share = (opendisplays ? opendisplays->window : NULL);
+    window = glfwCreateWindow(DISPLAY_DEFAULTWIDTH, DISPLAY_DEFAULTHEIGHT, DISPLAY_DEFAULTTITLE, NULL, share);
+    if (!window) {
+        free(new);
+        return NULL;
+    }
 
     new->width=DISPLAY_DEFAULTWIDTH;
     new->aspectRatio=((float) DISPLAY_DEFAULTWIDTH)/((float) DISPLAY_DEFAULTHEIGHT);
@@ -234,10 +280,13 @@ display *display_open(scene *s) {
     glfwSetScrollCallback(window, display_scrollcallback);
     glfwSetCursorPosCallback(window, display_cursorposncallback);
     glfwSetMouseButtonCallback(window, display_mousebuttoncallback);
+    glfwSetWindowRefreshCallback(window, display_refreshcallback);
+    glfwSetWindowIconifyCallback(window, display_iconifycallback);
     glfwSetWindowUserPointer(window, new);
     
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-        fprintf(stderr, "morphoview: Failed to initialize GLAD");
+    if (!displayglloaded) {
+        displayglloaded=gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+        if (!displayglloaded) fprintf(stderr, "morphoview: Failed to initialize GLAD");
     }
     
     /** Initialize the display */
@@ -255,27 +304,177 @@ void display_setwindowtitle(display *d, char *title) {
     if (d) glfwSetWindowTitle(d->window, title);
 }
 
+/** Sets a function to receive key presses for a display before they change the view */
+void display_setkeyfn(display *d, displaykeyfn keyfn, void *ref) {
+    d->keyfn=keyfn;
+    d->keyref=ref;
+}
+
 /* -------------------------------------------------------
  * Main loop
  * ------------------------------------------------------- */
 
-void display_loop(void) {
-    while (opendisplays!=NULL) {
-        for (display *d=opendisplays; d!=NULL; d=d->next) {
-            if (glfwWindowShouldClose(d->window)) {
-                glfwDestroyWindow(d->window);
-                display_remove(d);
-                break;
-            } else {
-                glfwMakeContextCurrent(d->window);
-                render_render(&d->render, d->aspectRatio, d->view);
-                
-                glfwSwapBuffers(d->window);
-            }
+/** Marks a display to be drawn again, e.g. as what it shows has changed */
+void display_redraw(display *d) {
+    d->dirty=true;
+}
+
+/** Sets whether displays are drawn continuously, reporting the GPU time taken to draw their objects */
+void display_setprofile(bool profile) {
+    displayprofiling=profile;
+    render_setprofile(profile);
+}
+
+/** Draws each open display that has changed since it was last drawn, skipping those that are iconified or hidden
+ *  @returns true if any displays remain open */
+static bool display_draw(void) {
+    display *next=NULL;
+    for (display *d=opendisplays; d!=NULL; d=next) {
+        next=d->next;
+        if (glfwWindowShouldClose(d->window)) {
+            display_remove(d);
+            continue;
         }
         
-        glfwPollEvents();
+        display_applydrag(d);
+        if (displayprofiling) d->dirty=true;
+        if (!d->dirty ||
+            glfwGetWindowAttrib(d->window, GLFW_ICONIFIED) ||
+            !glfwGetWindowAttrib(d->window, GLFW_VISIBLE)) continue;
+        
+        glfwMakeContextCurrent(d->window);
+        render_render(&d->render, d->aspectRatio, d->view);
+        
+        glfwSwapBuffers(d->window);
+        d->dirty=false;
+    }
+    
+    return (opendisplays!=NULL);
+}
+
+/** Draws each open display that has changed and processes pending events, without waiting for more
+ *  @returns true if any displays remain open */
+bool display_update(void) {
+    bool open=display_draw();
+    glfwPollEvents();
+    return open;
+}
+
+/** Draws each open display that has changed, then sleeps until an event arrives or a timeout elapses
+ *  @param[in] timeout - longest time to wait in seconds, or DISPLAY_WAITFOREVER
+ *  @returns true if any displays remain open */
+bool display_wait(double timeout) {
+    if (!display_draw()) return false;
+    
+    /* Displays left dirty are iconified or hidden, and are drawn once an event restores them */
+    if (timeout==0.0 || displayprofiling) glfwPollEvents();
+    else if (timeout<0.0) glfwWaitEvents();
+    else glfwWaitEventsTimeout(timeout);
+    
+    return true;
+}
+
+/** Shows the open displays until every window has been closed, drawing only in response to events */
+void display_loop(void) {
+    while (display_wait(DISPLAY_WAITFOREVER));
+}
+
+/** Checks whether a display is still open */
+bool display_isopen(display *d) {
+    for (display *e=opendisplays; e!=NULL; e=e->next) {
+        if (e==d) return true;
+    }
+    return false;
+}
+
+/** Finds an open display showing the scene with a given id
+ *  @param[in] id - the scene id
+ *  @returns the most recently opened such display, or NULL */
+display *display_findscene(int id) {
+    for (display *d=opendisplays; d!=NULL; d=d->next) {
+        if (d->s && d->s->id==id) return d;
+    }
+    return NULL;
+}
+
+/** Replaces the scene shown by a display, keeping the window and its view; the old scene is freed */
+void display_setscene(display *d, scene *s) {
+    glfwMakeContextCurrent(d->window);
+    render_reset(&d->render);
+    d->dirty=true;
+    
+    if (d->s!=s) scene_free(d->s);
+    d->s=s;
+}
+
+/** Replaces the scene shown by a display with a new version of it, keeping the window and its view. Only the data
+ *  that has changed is uploaded again, unless the layout of the scene has changed; the old scene is freed */
+void display_updatescene(display *d, scene *s) {
+    glfwMakeContextCurrent(d->window);
+    if (!render_updatescene(&d->render, d->s, s)) {
+        render_reset(&d->render);
+        render_preparescene(&d->render, s);
+    }
+    scene_clearedits(s);
+    d->dirty=true;
+    
+    if (d->s!=s) scene_free(d->s);
+    d->s=s;
+}
+
+/** Prepares a display's scene for rendering again, e.g. as more of it arrives or as it is edited; edits that leave
+ *  the layout of the scene unchanged are applied in place */
+void display_refresh(display *d) {
+    glfwMakeContextCurrent(d->window);
+    if (!render_applyedits(&d->render, d->s)) {
+        render_reset(&d->render);
+        render_preparescene(&d->render, d->s);
     }
+    scene_clearedits(d->s);
+    d->dirty=true;
+}
+
+/** Frees the vertex and element data of the scenes shown by every open display, now held only on the GPU. Their
+ *  scenes can't be edited or prepared again afterwards. */
+void display_releasegeometry(void) {
+    for (display *d=opendisplays; d!=NULL; d=d->next) {
+        if (d->s) scene_releasegeometry(d->s);
+    }
+}
+
+/* -------------------------------------------------------
+ * Scene sink
+ * ------------------------------------------------------- */
+
+/** Opens a window for each scene the parser creates */
+static void *display_sinkopen(void *ref, scene *s) {
+    return display_open(s);
+}
+
+static void display_sinksettitle(void *ref, void *handle, char *title) {
+    display_setwindowtitle((display *) handle, title);
+}
+
+static void display_sinkprepare(void *ref, void *handle, scene *s) {
+    if (handle) display_refresh((display *) handle);
+}
+
+static bool display_sinkisopen(void *ref, void *handle) {
+    return display_isopen((display *) handle);
+}
+
+static void display_sinkupdate(void *ref) {
+    display_update();
+}
+
+/** Initializes a scene sink that displays each scene in its own window */
+void display_sink(scenesink *sink) {
+    sink->open=display_sinkopen;
+    sink->settitle=display_sinksettitle;
+    sink->prepare=display_sinkprepare;
+    sink->isopen=display_sinkisopen;
+    sink->update=display_sinkupdate;
+    sink->ref=NULL;
 }
 
 /* -------------------------------------------------------
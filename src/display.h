@@ -30,8 +30,15 @@
 
 #define DISPLAY_DEFAULTTITLE "Morpho"
 
+/** Passed to display_wait to wait for events without a time limit */
+#define DISPLAY_WAITFOREVER -1.0
+
 typedef GLFWwindow windowref;
 
+/** Receives key presses for a display before they change the view
+ *  @returns true if the key was used */
+typedef bool (*displaykeyfn) (void *ref, int key, int mods);
+
 /** Display object corresponds to a discrete window */
 typedef struct sdisplay {
     struct sdisplay *next; /** Linked list */
@@ -43,6 +50,7 @@ typedef struct sdisplay {
     float aspectRatio; /** Aspect ratio for the window */
     
     double ox, oy; /** Previous mouse x,y positions */
+    double cx, cy; /** Latest mouse x,y positions while dragging, applied to the view when the window is drawn */
     
     enum {
         NORMAL,
@@ -52,13 +60,31 @@ typedef struct sdisplay {
     
     mat4x4 view; /** Current view matrix for window */
     
+    displaykeyfn keyfn; /** Receives key presses first, or NULL */
+    void *keyref; /** Reference passed to keyfn */
+    
+    bool dirty; /** Whether the window must be drawn again */
+    
     renderer render;
 } display;
 
 display *display_open(scene *s);
 void display_setwindowtitle(display *d, char *title);
+void display_setkeyfn(display *d, displaykeyfn keyfn, void *ref);
 
+void display_redraw(display *d);
+void display_setprofile(bool profile);
+bool display_update(void);
+bool display_wait(double timeout);
 void display_loop(void);
+bool display_isopen(display *d);
+void display_refresh(display *d);
+display *display_findscene(int id);
+void display_setscene(display *d, scene *s);
+void display_updatescene(display *d, scene *s);
+void display_releasegeometry(void);
+
+void display_sink(scenesink *sink);
 
 bool display_initialize(void);
 void display_finalize(void);
@@ -0,0 +1,359 @@
+/** @file extension.c
+ *  @author T J Atherton
+ *
+ *  @brief morpho extension that displays meshes, fields and arrays straight from morpho's memory
+ *  @details Scenes are built directly from morpho's matrices and connectivity with bulk calls, rather than being
+ *           printed as commands, written to disk and parsed again, and are displayed on the viewer thread while the
+ *           program carries on. Loaded into morpho with import morphoview; provides:
+ *
+ *  viewmesh(mesh)                  displays a Mesh
+ *  viewmesh(field)                 displays the Mesh of a scalar Field, colored by the field
+ *  viewarrays(vertices, elements)  displays vertices, the columns of a Matrix, joined by elements, the columns of a
+ *                                  Matrix or a List of Lists of vertex indices with two (lines) or three (facets) entries
+ *  viewwait()                      waits until every window has been closed
+ *
+ *  The viewing functions return the id of the new scene. On exit, morpho waits for any open windows to be closed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "morpho.h"
+#include "builtin.h"
+#include "matrix.h"
+#include "list.h"
+#include "mesh.h"
+#include "field.h"
+
+#include "scene.h"
+#include "text.h"
+#include "viewer.h"
+
+#define EXTENSION_VIEWMESH "viewmesh"
+#define EXTENSION_VIEWARRAYS "viewarrays"
+#define EXTENSION_VIEWWAIT "viewwait"
+
+#define EXTENSION_MESHARGS "MrphvwMshArgs"
+#define EXTENSION_MESHARGS_MSG "viewmesh expects a Mesh or a scalar Field."
+
+#define EXTENSION_ARRAYARGS "MrphvwArrArgs"
+#define EXTENSION_ARRAYARGS_MSG "viewarrays expects a Matrix of vertices and a Matrix or List of elements."
+
+#define EXTENSION_INDEX "MrphvwIndx"
+#define EXTENSION_INDEX_MSG "Elements must have two or three vertices, each a valid vertex index."
+
+#define EXTENSION_ALLOC "MrphvwAlloc"
+#define EXTENSION_ALLOC_MSG "Couldn't allocate the scene."
+
+/** Vertex format of scenes built by the extension */
+#define EXTENSION_FORMAT "xnc"
+#define EXTENSION_ENTRYSIZE 9
+
+/** Color of objects that aren't colored by a field */
+#define EXTENSION_COLOR 0.7f
+
+/** Id of the next scene */
+static int extensionsceneid = 0;
+
+/* -------------------------------------------------------
+ * Building scenes
+ * ------------------------------------------------------- */
+
+/** Creates a scene with a single object, whose vertices are the columns of a matrix
+ *  @param[in] vert - the vertices; coordinates beyond the third are ignored
+ *  @param[out] obj - the object
+ *  @returns the scene, or NULL on failure */
+static scene *extension_newscene(objectmatrix *vert, gobject **obj) {
+    scene *s = scene_new(extensionsceneid, 3);
+    if (!s) return NULL;
+    
+    *obj=scene_addobject(s, 1);
+    (*obj)->vertexdata.format=scene_addstring(s, EXTENSION_FORMAT, strlen(EXTENSION_FORMAT));
+    
+    int nv = (int) vert->ncols, dim = (int) (vert->nrows<3 ? vert->nrows : 3);
+    float *v = scene_reservedata(s, EXTENSION_ENTRYSIZE*nv, &(*obj)->vertexdata.indx);
+    if (!(*obj)->vertexdata.format || !v) {
+        scene_free(s);
+        return NULL;
+    }
+    (*obj)->vertexdata.length=EXTENSION_ENTRYSIZE*nv;
+    
+    /* Matrices are stored in column major order, so each vertex is contiguous */
+    for (int i=0; i<nv; i++) {
+        float *e = v + EXTENSION_ENTRYSIZE*i;
+        double *x = vert->elements + i*vert->nrows;
+        for (int k=0; k<3; k++) e[k] = (k<dim ? (float) x[k] : 0.0f);
+        for (int k=3; k<6; k++) e[k] = 0.0f;
+        for (int k=6; k<9; k++) e[k] = EXTENSION_COLOR;
+    }
+    
+    scene_adddraw(s, OBJECT, 1, SCENE_EMPTY);
+    return s;
+}
+
+/** Reserves space for an element with a given number of vertex indices
+ *  @returns a pointer to the indices, to be filled out by the caller, or NULL on failure */
+static int *extension_addelement(scene *s, gobject *obj, gelementtype type, int count) {
+    gelement el = { .type = type, .indx = SCENE_EMPTY, .length = count };
+    int *out = scene_reserveindex(s, count, &el.indx);
+    if (out && scene_addelement(s, obj, &el)<0) out=NULL;
+    return out;
+}
+
+/** Checks that the vertex indices of an element are valid */
+static bool extension_checkindices(int *indx, int count, int nv) {
+    for (int i=0; i<count; i++) if (indx[i]<0 || indx[i]>=nv) return false;
+    return true;
+}
+
+/** Computes vertex normals from the facets of an object, for lighting */
+static void extension_computenormals(scene *s, gobject *obj) {
+    float *v = s->data.data + obj->vertexdata.indx;
+    int nv = obj->vertexdata.length/EXTENSION_ENTRYSIZE;
+    
+    /* Each facet adds its normal, weighted by its area, to those of its vertices */
+    for (unsigned int i=0; i<obj->elements.count; i++) {
+        gelement *el = &obj->elements.data[i];
+        if (el->type!=FACETS) continue;
+        
+        int *f = s->indx.data + el->indx;
+        for (int j=0; j+2<el->length; j+=3) {
+            float *a = v + EXTENSION_ENTRYSIZE*f[j], *b = v + EXTENSION_ENTRYSIZE*f[j+1], *c = v + EXTENSION_ENTRYSIZE*f[j+2];
+            float u[3], w[3], n[3];
+            for (int k=0; k<3; k++) {
+                u[k]=b[k]-a[k];
+                w[k]=c[k]-a[k];
+            }
+            n[0]=u[1]*w[2]-u[2]*w[1];
+            n[1]=u[2]*w[0]-u[0]*w[2];
+            n[2]=u[0]*w[1]-u[1]*w[0];
+            
+            for (int k=0; k<3; k++) {
+                a[3+k]+=n[k];
+                b[3+k]+=n[k];
+                c[3+k]+=n[k];
+            }
+        }
+    }
+    
+    /* Vertices on no facet, e.g. of lines or of a planar mesh, face the viewer */
+    for (int i=0; i<nv; i++) {
+        float *n = v + EXTENSION_ENTRYSIZE*i + 3;
+        float norm = sqrtf(n[0]*n[0]+n[1]*n[1]+n[2]*n[2]);
+        if (norm>0) for (int k=0; k<3; k++) n[k]/=norm;
+        else n[2]=1.0f;
+    }
+}
+
+/** Colors the vertices of an object by a scalar value at each vertex, from blue at the minimum to red */
+static void extension_colorbyvalue(scene *s, gobject *obj, double *values) {
+    float *v = s->data.data + obj->vertexdata.indx;
+    int nv = obj->vertexdata.length/EXTENSION_ENTRYSIZE;
+    if (nv==0) return;
+    
+    double min=values[0], max=values[0];
+    for (int i=1; i<nv; i++) {
+        if (values[i]<min) min=values[i];
+        if (values[i]>max) max=values[i];
+    }
+    
+    for (int i=0; i<nv; i++) {
+        float t = (float) (max>min ? (values[i]-min)/(max-min) : 0.5);
+        float *c = v + EXTENSION_ENTRYSIZE*i + 6;
+        c[0]=t;
+        c[1]=1.0f-fabsf(2.0f*t-1.0f);
+        c[2]=1.0f-t;
+    }
+}
+
+/** Adds the elements of a grade of a mesh to an object
+ *  @returns true on success */
+static bool extension_addmeshgrade(scene *s, gobject *obj, objectmesh *mesh, grade g) {
+    objectsparse *conn = mesh_getconnectivityelement(mesh, 0, g);
+    if (!conn) return true;
+    
+    int nel = mesh_nelements(conn), length = (int) g+1;
+    int *out = extension_addelement(s, obj, (g==2 ? FACETS : LINES), nel*length);
+    if (!out && nel>0) return false;
+    
+    for (int i=0; i<nel; i++) {
+        int nentries, *entries;
+        if (!mesh_getconnectivity(conn, i, &nentries, &entries) || nentries!=length) return false;
+        memcpy(out+i*length, entries, sizeof(int)*length);
+    }
+    return true;
+}
+
+/** Adds elements given as the columns of a matrix to an object
+ *  @returns true on success */
+static bool extension_addmatrixelements(scene *s, gobject *obj, objectmatrix *m, int nv) {
+    int length = (int) m->nrows;
+    if (length!=2 && length!=3) return false;
+    
+    int *out = extension_addelement(s, obj, (length==3 ? FACETS : LINES), length*(int) m->ncols);
+    if (!out && m->ncols>0) return false;
+    
+    for (unsigned int i=0; i<m->nrows*m->ncols; i++) out[i]=(int) m->elements[i];
+    return extension_checkindices(out, length*(int) m->ncols, nv);
+}
+
+/** Adds elements given as a list of lists of vertex indices to an object, lines and facets separately
+ *  @returns true on success */
+static bool extension_addlistelements(scene *s, gobject *obj, objectlist *list, int nv) {
+    for (int length=2; length<=3; length++) {
+        int n=0;
+        for (unsigned int i=0; i<list->val.count; i++) {
+            value el = list->val.data[i];
+            if (!MORPHO_ISLIST(el)) return false;
+            int count = (int) MORPHO_GETLIST(el)->val.count;
+            if (count!=2 && count!=3) return false;
+            if (count==length) n++;
+        }
+        if (n==0) continue;
+        
+        int *out = extension_addelement(s, obj, (length==3 ? FACETS : LINES), length*n);
+        if (!out) return false;
+        
+        for (unsigned int i=0; i<list->val.count; i++) {
+            objectlist *el = MORPHO_GETLIST(list->val.data[i]);
+            if (el->val.count!=length) continue;
+            for (int k=0; k<length; k++) {
+                if (!morpho_valuetoint(el->val.data[k], out+k)) return false;
+            }
+            if (!extension_checkindices(out, length, nv)) return false;
+            out+=length;
+        }
+    }
+    return true;
+}
+
+/** Hands a finished scene to the viewer
+ *  @returns the scene id as a value */
+static value extension_show(scene *s, gobject *obj) {
+    extension_computenormals(s, obj);
+    viewer_show(s, NULL);
+    return MORPHO_INTEGER(extensionsceneid++);
+}
+
+/* -------------------------------------------------------
+ * morpho functions
+ * ------------------------------------------------------- */
+
+/** viewmesh(mesh) or viewmesh(field) */
+static value extension_viewmesh(vm *v, int nargs, value *args) {
+    objectmesh *mesh = NULL;
+    objectfield *field = NULL;
+    
+    if (nargs==1 && MORPHO_ISMESH(MORPHO_GETARG(args, 0))) {
+        mesh=MORPHO_GETMESH(MORPHO_GETARG(args, 0));
+    } else if (nargs==1 && MORPHO_ISFIELD(MORPHO_GETARG(args, 0))) {
+        field=MORPHO_GETFIELD(MORPHO_GETARG(args, 0));
+        mesh=field->mesh;
+    }
+    
+    if (!mesh || !mesh->vert) {
+        morpho_runtimeerror(v, EXTENSION_MESHARGS);
+        return MORPHO_NIL;
+    }
+    
+    gobject *obj;
+    scene *s = extension_newscene(mesh->vert, &obj);
+    bool success = (s!=NULL);
+    
+    for (grade g=1; g<=2 && success; g++) success=extension_addmeshgrade(s, obj, mesh, g);
+    
+    /* Color by the field's value at each vertex */
+    if (success && field) {
+        int nv = (int) mesh->vert->ncols;
+        double *values = malloc(sizeof(double)*(nv+1));
+        success=(values!=NULL);
+        
+        for (int i=0; i<nv && success; i++) {
+            value val;
+            success=(field_getelement(field, 0, i, 0, &val) && morpho_valuetofloat(val, values+i));
+        }
+        
+        if (success) extension_colorbyvalue(s, obj, values);
+        else morpho_runtimeerror(v, EXTENSION_MESHARGS);
+        free(values);
+        
+        if (!success) {
+            scene_free(s);
+            return MORPHO_NIL;
+        }
+    }
+    
+    if (!success) {
+        if (s) scene_free(s);
+        morpho_runtimeerror(v, EXTENSION_ALLOC);
+        return MORPHO_NIL;
+    }
+    
+    return extension_show(s, obj);
+}
+
+/** viewarrays(vertices, elements) */
+static value extension_viewarrays(vm *v, int nargs, value *args) {
+    if (nargs!=2 || !MORPHO_ISMATRIX(MORPHO_GETARG(args, 0)) ||
+        !(MORPHO_ISMATRIX(MORPHO_GETARG(args, 1)) || MORPHO_ISLIST(MORPHO_GETARG(args, 1)))) {
+        morpho_runtimeerror(v, EXTENSION_ARRAYARGS);
+        return MORPHO_NIL;
+    }
+    
+    objectmatrix *vert = MORPHO_GETMATRIX(MORPHO_GETARG(args, 0));
+    value elements = MORPHO_GETARG(args, 1);
+    int nv = (int) vert->ncols;
+    
+    gobject *obj;
+    scene *s = extension_newscene(vert, &obj);
+    if (!s) {
+        morpho_runtimeerror(v, EXTENSION_ALLOC);
+        return MORPHO_NIL;
+    }
+    
+    bool success;
+    if (MORPHO_ISMATRIX(elements)) success=extension_addmatrixelements(s, obj, MORPHO_GETMATRIX(elements), nv);
+    else success=extension_addlistelements(s, obj, MORPHO_GETLIST(elements), nv);
+    
+    if (!success) {
+        scene_free(s);
+        morpho_runtimeerror(v, EXTENSION_INDEX);
+        return MORPHO_NIL;
+    }
+    
+    return extension_show(s, obj);
+}
+
+/** viewwait() */
+static value extension_viewwait(vm *v, int nargs, value *args) {
+    viewer_wait();
+    return MORPHO_NIL;
+}
+
+/* -------------------------------------------------------
+ * Initialization/Finalization
+ * ------------------------------------------------------- */
+
+/** Called by morpho as the extension is loaded */
+void morphoview_initialize(void) {
+    scene_initialize();
+    text_initialize();
+    viewer_initialize();
+    
+    builtin_addfunction(EXTENSION_VIEWMESH, extension_viewmesh, BUILTIN_FLAGSEMPTY);
+    builtin_addfunction(EXTENSION_VIEWARRAYS, extension_viewarrays, BUILTIN_FLAGSEMPTY);
+    builtin_addfunction(EXTENSION_VIEWWAIT, extension_viewwait, BUILTIN_FLAGSEMPTY);
+    
+    morpho_defineerror(EXTENSION_MESHARGS, ERROR_HALT, EXTENSION_MESHARGS_MSG);
+    morpho_defineerror(EXTENSION_ARRAYARGS, ERROR_HALT, EXTENSION_ARRAYARGS_MSG);
+    morpho_defineerror(EXTENSION_INDEX, ERROR_HALT, EXTENSION_INDEX_MSG);
+    morpho_defineerror(EXTENSION_ALLOC, ERROR_HALT, EXTENSION_ALLOC_MSG);
+}
+
+/** Called by morpho as it exits; windows stay open until they are closed */
+void morphoview_finalize(void) {
+    viewer_finalize();
+    text_finalize();
+    scene_finalize();
+}
@@ -0,0 +1,96 @@
+/** @file hash.c
+ *  @author T J Atherton
+ *
+ *  @brief Fast non-cryptographic hashing of file contents
+ */
+
+#include <string.h>
+
+#include "hash.h"
+
+/* Data is hashed 32 bytes at a time into four independent 64 bit accumulators, so that the multiplications of
+   successive words overlap, in the manner of xxHash64; the accumulators are then merged with the tail of the data
+   and the length, and the result mixed so that every input bit affects every output bit. */
+
+#define HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME3 0x165667B19E3779F9ULL
+#define HASH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME5 0x27D4EB2F165667C5ULL
+
+/** Rotates a word left by r bits */
+static uint64_t hash_rotate(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/** Reads a word from unaligned memory */
+static uint64_t hash_read(const unsigned char *p) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(uint64_t));
+    return w;
+}
+
+/** Accumulates a word */
+static uint64_t hash_round(uint64_t acc, uint64_t w) {
+    acc += w * HASH_PRIME2;
+    acc = hash_rotate(acc, 31);
+    return acc * HASH_PRIME1;
+}
+
+/** Merges an accumulator into the hash */
+static uint64_t hash_merge(uint64_t h, uint64_t acc) {
+    h ^= hash_round(0, acc);
+    return h * HASH_PRIME1 + HASH_PRIME4;
+}
+
+/** Hashes a block of memory
+ *  @param[in] data - the data
+ *  @param[in] length - its length in bytes
+ *  @param[in] seed - distinguishes otherwise identical hashes
+ *  @returns a 64 bit hash of the data */
+uint64_t hash_bytes(const void *data, size_t length, uint64_t seed) {
+    const unsigned char *p = data, *end = p + length;
+    uint64_t h;
+    
+    if (length>=32) {
+        uint64_t v1 = seed + HASH_PRIME1 + HASH_PRIME2, v2 = seed + HASH_PRIME2,
+                 v3 = seed, v4 = seed - HASH_PRIME1;
+        
+        for (; end-p>=32; p+=32) {
+            v1 = hash_round(v1, hash_read(p));
+            v2 = hash_round(v2, hash_read(p+8));
+            v3 = hash_round(v3, hash_read(p+16));
+            v4 = hash_round(v4, hash_read(p+24));
+        }
+        
+        h = hash_rotate(v1, 1) + hash_rotate(v2, 7) + hash_rotate(v3, 12) + hash_rotate(v4, 18);
+        h = hash_merge(h, v1);
+        h = hash_merge(h, v2);
+        h = hash_merge(h, v3);
+        h = hash_merge(h, v4);
+    } else {
+        h = seed + HASH_PRIME5;
+    }
+    
+    h += (uint64_t) length;
+    
+    /* The remaining words and bytes */
+    for (; end-p>=8; p+=8) {
+        h ^= hash_round(0, hash_read(p));
+        h = hash_rotate(h, 27) * HASH_PRIME1 + HASH_PRIME4;
+    }
+    
+    for (; p<end; p++) {
+        h ^= (*p) * HASH_PRIME5;
+        h = hash_rotate(h, 11) * HASH_PRIME1;
+    }
+    
+    /* Final mix */
+    h ^= h >> 33;
+    h *= HASH_PRIME2;
+    h ^= h >> 29;
+    h *= HASH_PRIME3;
+    h ^= h >> 32;
+    
+    return h;
+}
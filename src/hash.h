@@ -0,0 +1,19 @@
+/** @file hash.h
+ *  @author T J Atherton
+ *
+ *  @brief Fast non-cryptographic hashing of file contents
+ */
+
+#ifndef hash_h
+#define hash_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+uint64_t hash_bytes(const void *data, size_t length, uint64_t seed);
+
+#endif /* hash_h */
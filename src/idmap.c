@@ -0,0 +1,118 @@
+/** @file idmap.c
+ *  @author T J Atherton
+ *
+ *  @brief Maps ids to positions in a list, so that objects can be found without a linear search
+ */
+
+#include <stdlib.h>
+
+#include "idmap.h"
+
+/* -------------------------------------------------------
+ * Hashing
+ * ------------------------------------------------------- */
+
+/** Mixes the bits of a key so that consecutive ids are spread over the table */
+static uint64_t idmap_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+/** Finds the entry holding a key, or the empty entry where it would be inserted */
+static unsigned int idmap_find(idmap *m, uint64_t key) {
+    unsigned int mask = m->size-1;
+    unsigned int i = (unsigned int) idmap_hash(key) & mask;
+    
+    while (m->values[i]>=0 && m->keys[i]!=key) i=(i+1) & mask;
+    return i;
+}
+
+/* -------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------- */
+
+/** Initializes an empty map; no memory is allocated until a key is inserted */
+void idmap_init(idmap *m) {
+    m->keys=NULL;
+    m->values=NULL;
+    m->count=0;
+    m->size=0;
+}
+
+/** Frees a map's table */
+void idmap_clear(idmap *m) {
+    free(m->keys);
+    free(m->values);
+    idmap_init(m);
+}
+
+/** Removes every key from a map, keeping its table */
+void idmap_empty(idmap *m) {
+    for (unsigned int i=0; i<m->size; i++) m->values[i]=-1;
+    m->count=0;
+}
+
+/** Resizes a map's table, reinserting its keys */
+static bool idmap_resize(idmap *m, unsigned int size) {
+    uint64_t *keys = malloc(sizeof(uint64_t)*size);
+    int *values = malloc(sizeof(int)*size);
+    if (!keys || !values) {
+        free(keys);
+        free(values);
+        return false;
+    }
+    for (unsigned int i=0; i<size; i++) values[i]=-1;
+    
+    idmap old = *m;
+    m->keys=keys;
+    m->values=values;
+    m->size=size;
+    
+    for (unsigned int i=0; i<old.size; i++) {
+        if (old.values[i]<0) continue;
+        unsigned int j=idmap_find(m, old.keys[i]);
+        m->keys[j]=old.keys[i];
+        m->values[j]=old.values[i];
+    }
+    
+    free(old.keys);
+    free(old.values);
+    return true;
+}
+
+/** Looks up a key
+ *  @param[in] m - the map
+ *  @param[in] key - key to find
+ *  @param[out] value - the index stored for the key
+ *  @returns true if the key was found */
+bool idmap_get(idmap *m, uint64_t key, int *value) {
+    if (m->count==0) return false;
+    
+    unsigned int i=idmap_find(m, key);
+    if (m->values[i]<0) return false;
+    
+    *value=m->values[i];
+    return true;
+}
+
+/** Inserts a key unless it's present already, so that the first of several entries with the same id is found, as by
+ *  a linear search
+ *  @param[in] m - the map
+ *  @param[in] key - key to insert
+ *  @param[in] value - index to store for the key; must not be negative
+ *  @returns true on success, including if the key was present already */
+bool idmap_insert(idmap *m, uint64_t key, int value) {
+    if (2*(m->count+1)>m->size && !idmap_resize(m, (m->size ? 2*m->size : IDMAP_MINSIZE))) return false;
+    
+    unsigned int i=idmap_find(m, key);
+    if (m->values[i]<0) {
+        m->keys[i]=key;
+        m->values[i]=value;
+        m->count++;
+    }
+    return true;
+}
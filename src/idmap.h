@@ -0,0 +1,36 @@
+/** @file idmap.h
+ *  @author T J Atherton
+ *
+ *  @brief Maps ids to positions in a list, so that objects can be found without a linear search
+ */
+
+#ifndef idmap_h
+#define idmap_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Initial number of entries in a map's table; must be a power of two */
+#define IDMAP_MINSIZE 16
+
+/** @brief A hash table from keys, such as ids, to indices into an accompanying varray
+ *  @details Open addressing with linear probing; the table is kept at most half full. Indices must not be negative. */
+typedef struct {
+    uint64_t *keys;
+    int *values; /** Index for each key, or -1 for an empty entry */
+    unsigned int count; /** Number of keys held */
+    unsigned int size; /** Number of entries in the table: 0 or a power of two */
+} idmap;
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+void idmap_init(idmap *m);
+void idmap_clear(idmap *m);
+void idmap_empty(idmap *m);
+
+bool idmap_get(idmap *m, uint64_t key, int *value);
+bool idmap_insert(idmap *m, uint64_t key, int value);
+
+#endif /* idmap_h */
@@ -8,48 +8,101 @@
 #include <string.h>
 
 #include "command.h"
+#include "cache.h"
 #include "display.h"
+#include "server.h"
 #include "text.h"
+#include "watch.h"
+#include "playback.h"
 
 int main(int argc, const char * argv[]) {
     scene_initialize();
     display_initialize();
     text_initialize();
     bool temp = false;
+    bool cache = false;
     bool parsed = false;
+    bool server = false;
+    bool watch = false;
+    bool sequence = false;
+    bool keep = false;
+    const char *socket = NULL;
     
-    // Process arguments
+    // Scenes are displayed in windows as they are parsed
+    scenesink sink;
+    display_sink(&sink);
+    
+    // Process arguments; with -s each file is a frame of a sequence
     const char *file=NULL;
+    const char *files[argc];
+    int nfiles=0;
     for (unsigned int i=1; i<argc; i++) {
         const char *option = argv[i];
-        if (argv[i] && option[0]=='-') {
+        if (argv[i] && option[0]=='-' && option[1]!='\0') {
             switch (option[1]) {
+                case '-': /* Persistent viewer, as --server or --server=path */
+                    if (strncmp(option, "--server", 8)==0) {
+                        server=true;
+                        if (option[8]=='=') socket=option+9;
+                    }
+                    break;
                 case 't': /* Temporary file; delete after */
                     temp=true;
                     break;
+                case 'c': /* Reuse scenes cached from an earlier run */
+                    cache=true;
+                    break;
+                case 'w': /* Reload the file whenever it changes */
+                    watch=true;
+                    break;
+                case 's': /* Play the files as the frames of a sequence */
+                    sequence=true;
+                    break;
+                case 'k': /* Keep vertex and element data in memory once it has been uploaded */
+                    keep=true;
+                    break;
+                case 'p': /* Draw continuously, reporting the GPU time taken */
+                    display_setprofile(true);
+                    break;
+                case 'j': /* Number of threads used to parse, as -j N or -jN */
+                    if (option[2]!='\0') command_setthreads(atoi(option+2));
+                    else if (i+1<argc) command_setthreads(atoi(argv[++i]));
+                    break;
             }
         } else {
             file = option;
+            files[nfiles++] = option;
         }
     }
     
-    // Parse a command file if provided
-    if (file) {
-        char *buffer = NULL;
+    // Parse a command file if provided; pipes and standard input ('-') are displayed as they arrive
+    if (server) {
+        server_run(socket);
+    } else if (sequence && nfiles>0) {
+        playback_run(nfiles, files, cache);
+    } else if (watch && file && !command_isstream(file)) {
+        watch_run(file, cache);
+    } else if (file && command_isstream(file)) {
+        parsed=command_parsestream(file, &sink);
+    } else if (file) {
+        commandinput input;
         //printf("Loading %s\n", file);
         
-        if (command_loadinput(file, &buffer)) {
-            parsed=command_parse(buffer);
+        if (command_loadinput(file, &input)) {
+            parsed=(cache ? cache_parseinput(&input, &sink) : command_parseinput(&input, &sink));
+            command_freeinput(&input);
         }
-        
-        free(buffer);
     }
     
-    if (parsed) display_loop();
+    // Once parsing is complete, the scenes' geometry is only needed on the GPU
+    if (parsed) {
+        if (!keep) display_releasegeometry();
+        display_loop();
+    }
     
     text_finalize();
     display_finalize();
     scene_finalize();
     
-    if (temp && file) command_removefile(file);
+    if (temp && file && !command_isstream(file)) command_removefile(file);
 }
@@ -113,6 +113,28 @@ void mat3d_invert4x4(mat4x4 a, mat4x4 out) {
     }
 }
 
+/** @brief Normal matrix, the inverse transpose of the upper left 3x3 block, which transforms normals
+ * @param[in] a input matrix
+ * @param[out] out filled with the normal matrix
+ * @details Computed from the cofactors of the block, which is far cheaper than a general inverse. A singular block
+ * gives its cofactor matrix, which still points normals the right way where it can. */
+void mat3d_normalmatrix(mat4x4 a, mat3x3 out) {
+    /* Elements of the block, in column major order */
+    float a00=a[0], a10=a[1], a20=a[2];
+    float a01=a[4], a11=a[5], a21=a[6];
+    float a02=a[8], a12=a[9], a22=a[10];
+    
+    /* Cofactors; the inverse transpose is the cofactor matrix divided by the determinant */
+    mat3x3 c = { a11*a22-a12*a21, a02*a21-a01*a22, a01*a12-a02*a11,
+                 a12*a20-a10*a22, a00*a22-a02*a20, a02*a10-a00*a12,
+                 a10*a21-a11*a20, a01*a20-a00*a21, a00*a11-a01*a10 };
+    
+    float det = a00*c[0] + a01*c[3] + a02*c[6];
+    float scale = (det!=0.0f ? 1.0f/det : 1.0f);
+    
+    for (int i=0; i<9; i++) out[i]=scale*c[i];
+}
+
 /** @brief Convert a 3x3 matrix to a 4x4 matrix
  * @param[in] in input matrix
  * @param[out] out filled with inverse(a)  */
@@ -26,6 +26,7 @@ void mat3d_addscale3x3(mat3x3 a, float alpha, mat3x3 b, mat3x3 out);
 void mat3d_copy4x4(mat4x4 a, mat4x4 out);
 
 void mat3d_invert4x4(mat4x4 a, mat4x4 out);
+void mat3d_normalmatrix(mat4x4 a, mat3x3 out);
 
 void mat3d_print3x3(mat3x3 in);
 void mat3d_print4x4(mat4x4 in);
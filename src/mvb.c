@@ -0,0 +1,616 @@
+/** @file mvb.c
+ *  @author T J Atherton
+ *
+ *  @brief Binary scene format for morphoview
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mvb.h"
+#include "scene.h"
+#include "matrix3d.h"
+
+/** @brief State of the reader as it works through the records, which mirrors that of the command parser */
+typedef struct {
+    scene *scene;
+    scenesink *sink; /* Receives scenes as they are created */
+    void *view; /* Handle given by the sink for the current scene */
+
+    mat4x4 model; /* The model matrix */
+    bool modelchanged;
+
+    gobject *cobject;
+} mvbreader;
+
+/** @brief Arguments of a record */
+typedef struct {
+    char command;
+    const char *str; /* String argument; not terminated */
+    uint32_t strlength;
+    const void *words; /* 32 bit words */
+    uint32_t count;
+} mvbargs;
+
+/** @brief Definition of a function that processes a record */
+typedef bool (*mvbfunction) (mvbreader *r, mvbargs *a);
+
+#define ERRCHK(f) if (!(f)) return false;
+
+/* -------------------------------------------------------
+ * Utility functions
+ * ------------------------------------------------------- */
+
+/** Rounds a length up to the alignment of records */
+static uint64_t mvb_pad(uint64_t length) {
+    return (length + MVB_ALIGN - 1) & ~((uint64_t) MVB_ALIGN - 1);
+}
+
+/** Gets word i of a record as an integer */
+static int mvb_int(mvbargs *a, uint32_t i) {
+    int32_t out;
+    memcpy(&out, (const char *) a->words + 4*i, sizeof(int32_t));
+    return (int) out;
+}
+
+/** Gets word i of a record as a float */
+static float mvb_float(mvbargs *a, uint32_t i) {
+    float out;
+    memcpy(&out, (const char *) a->words + 4*i, sizeof(float));
+    return out;
+}
+
+/** Copies the string argument of a record into a newly allocated, terminated string */
+static char *mvb_string(mvbargs *a) {
+    char *str = malloc(a->strlength+1);
+    if (str) {
+        memcpy(str, a->str, a->strlength);
+        str[a->strlength]='\0';
+    }
+    return str;
+}
+
+/** Checks that a record has at least the expected number of words */
+static bool mvb_checkcount(mvbargs *a, uint32_t count) {
+    if (a->count<count) {
+        fprintf(stderr, "morphoview: Malformed '%c' record in binary file.\n", a->command);
+        return false;
+    }
+    return true;
+}
+
+/** Checks that a scene is available */
+static bool mvb_checkscene(mvbreader *r) {
+    if (!r->scene) {
+        fprintf(stderr, "morphoview: No scene defined.\n");
+        return false;
+    }
+    return true;
+}
+
+/** Checks that a scene and object are available */
+static bool mvb_checkobject(mvbreader *r) {
+    if (!r->scene || !r->cobject) {
+        fprintf(stderr, "morphoview: No object defined.\n");
+        return false;
+    }
+    return true;
+}
+
+/* -------------------------------------------------------
+ * Records
+ * ------------------------------------------------------- */
+
+/** Scene record */
+static bool mvb_scene(mvbreader *r, mvbargs *a) {
+    ERRCHK(mvb_checkcount(a, 2));
+
+    /* Finish preparing the previous scene */
+    if (r->scene && scene_sinkisopen(r->sink, r->view)) scene_sinkprepare(r->sink, r->view, r->scene);
+
+    r->scene = scene_new(mvb_int(a, 0), mvb_int(a, 1));
+    r->cobject = NULL; /* The sink may free the previous scene */
+    if (r->scene) r->view=scene_sinkopen(r->sink, r->scene);
+
+    return (r->scene!=NULL);
+}
+
+/** Window record */
+static bool mvb_window(mvbreader *r, mvbargs *a) {
+    ERRCHK(mvb_checkscene(r));
+
+    char *name = mvb_string(a);
+    if (!name) return false;
+
+    scene_sinksettitle(r->sink, r->view, name);
+    free(name);
+    return true;
+}
+
+/** Color definition record */
+static bool mvb_color(mvbreader *r, mvbargs *a) {
+    ERRCHK(mvb_checkscene(r));
+    ERRCHK(mvb_checkcount(a, 1));
+
+    uint32_t count = a->count-1;
+    if (count%3!=0) {
+        fprintf(stderr, "morphoview: Incomplete color definition.\n");
+        return false;
+    }
+
+    if (count>0) {
+        /* The words needn't be aligned, so they are copied to the end of the data array to be read from there */
+        int indx;
+        float *f=scene_reservedata(r->scene, (int) count, &indx);
+        if (!f) return false;
+        memcpy(f, (const char *) a->words + 4, count*sizeof(float));
+        int ret=scene_addcolor(r->scene, mvb_int(a, 0), f, (int) count/3);
+        scene_releasedata(r->scene, indx);
+        ERRCHK(ret>=0);
+    }
+
+    return true;
+}
+
+/** Color selection record */
+static bool mvb_selectcolor(mvbreader *r, mvbargs *a) {
+    ERRCHK(mvb_checkscene(r));
+    ERRCHK(mvb_checkcount(a, 1));
+    scene_adddraw(r->scene, COLOR, mvb_int(a, 0), -1);
+    return true;
+}
+
+/** Object record */
+static bool mvb_object(mvbreader *r, mvbargs *a) {
+    ERRCHK(mvb_checkscene(r));
+    ERRCHK(mvb_checkcount(a, 1));
+
+    r->cobject=scene_addobject(r->scene, mvb_int(a, 0));
+    return true;
+}
+
+/** Vertex record; the block is copied straight into the scene's data array */
+static bool mvb_vertices(mvbreader *r, mvbargs *a) {
+    ERRCHK(mvb_checkobject(r));
+
+    if (a->strlength>0) {
+        char *format = scene_addstring(r->scene, a->str, a->strlength);
+        if (!format) return false;
+        r->cobject->vertexdata.format=format;
+    }
+
+    if (a->count>0) {
+        int indx;
+        float *f=scene_reservedata(r->scene, (int) a->count, &indx);
+        if (!f) return false;
+        memcpy(f, a->words, a->count*sizeof(float));
+
+        if (r->cobject->vertexdata.indx==SCENE_EMPTY) {
+            r->cobject->vertexdata.indx=indx;
+            r->cobject->vertexdata.length=0;
+        }
+        r->cobject->vertexdata.length+=(int) a->count;
+    }
+
+    return true;
+}
+
+/** Points, lines and facets records; the indices are copied straight into the scene's index array */
+static bool mvb_index(mvbreader *r, mvbargs *a) {
+    ERRCHK(mvb_checkobject(r));
+
+    gelement el = { .type = POINTS, .indx = SCENE_EMPTY, .length = 0 };
+    if (a->command=='l') el.type=LINES;
+    else if (a->command=='f') el.type=FACETS;
+
+    if (a->count>0) {
+        int *i=scene_reserveindex(r->scene, (int) a->count, &el.indx);
+        if (!i) return false;
+
+        if (sizeof(int)==sizeof(int32_t)) memcpy(i, a->words, a->count*sizeof(int));
+        else for (uint32_t k=0; k<a->count; k++) i[k]=mvb_int(a, k);
+
+        el.length=(int) a->count;
+    }
+
+    ERRCHK(scene_addelement(r->scene, r->cobject, &el)>=0);
+    return true;
+}
+
+/** Draw record */
+static bool mvb_draw(mvbreader *r, mvbargs *a) {
+    int indx = SCENE_EMPTY;
+    ERRCHK(mvb_checkscene(r));
+    ERRCHK(mvb_checkcount(a, 1));
+
+    if (r->modelchanged) {
+        indx=scene_addmatrix(r->scene, r->model);
+        r->modelchanged=false;
+    }
+
+    scene_adddraw(r->scene, OBJECT, mvb_int(a, 0), indx);
+    return true;
+}
+
+/** Identity record */
+static bool mvb_identity(mvbreader *r, mvbargs *a) {
+    mat3d_identity4x4(r->model);
+    r->modelchanged=true;
+    return true;
+}
+
+/** Matrix record */
+static bool mvb_matrix(mvbreader *r, mvbargs *a) {
+    mat4x4 x, m;
+    ERRCHK(mvb_checkcount(a, 16));
+
+    for (int i=0; i<16; i++) x[i]=mvb_float(a, i);
+
+    mat3d_copy4x4(r->model, m);
+    mat3d_mul4x4(m, x, r->model);
+    r->modelchanged=true;
+    return true;
+}
+
+/** Rotate record */
+static bool mvb_rotate(mvbreader *r, mvbargs *a) {
+    float x[3];
+    ERRCHK(mvb_checkcount(a, 4));
+
+    for (int i=0; i<3; i++) x[i]=mvb_float(a, i+1);
+
+    mat3d_rotate(r->model, x, mvb_float(a, 0), r->model);
+    r->modelchanged=true;
+    return true;
+}
+
+/** Scale record */
+static bool mvb_scale(mvbreader *r, mvbargs *a) {
+    ERRCHK(mvb_checkcount(a, 1));
+
+    mat3d_scale(r->model, mvb_float(a, 0), r->model);
+    r->modelchanged=true;
+    return true;
+}
+
+/** Translate record */
+static bool mvb_translate(mvbreader *r, mvbargs *a) {
+    float x[3];
+    ERRCHK(mvb_checkcount(a, 3));
+
+    for (int i=0; i<3; i++) x[i]=mvb_float(a, i);
+
+    mat3d_translate(r->model, x, r->model);
+    r->modelchanged=true;
+    return true;
+}
+
+/** Font record */
+static bool mvb_font(mvbreader *r, mvbargs *a) {
+    ERRCHK(mvb_checkscene(r));
+    ERRCHK(mvb_checkcount(a, 2));
+
+    char *file = mvb_string(a);
+    if (!file) return false;
+
+    bool success=scene_addfont(r->scene, mvb_int(a, 0), file, mvb_float(a, 1), NULL);
+    free(file);
+    return success;
+}
+
+/** Text record */
+static bool mvb_text(mvbreader *r, mvbargs *a) {
+    ERRCHK(mvb_checkscene(r));
+    ERRCHK(mvb_checkcount(a, 1));
+
+    char *string = scene_addstring(r->scene, a->str, a->strlength);
+    if (!string) return false;
+
+    int matindx=SCENE_EMPTY;
+    int tid=scene_addtext(r->scene, mvb_int(a, 0), string);
+
+    if (r->modelchanged) {
+        matindx=scene_addmatrix(r->scene, r->model);
+        r->modelchanged=false;
+    }
+
+    scene_adddraw(r->scene, TEXT, tid, matindx);
+    return true;
+}
+
+/** Shared data record */
+static bool mvb_shared(mvbreader *r, mvbargs *a) {
+    ERRCHK(mvb_checkobject(r));
+    ERRCHK(mvb_checkcount(a, 3));
+
+    /* The string holds the segment name and the format, separated by a zero byte */
+    char *name = mvb_string(a);
+    if (!name) return false;
+    size_t namelength = strlen(name);
+    char *format = (namelength<a->strlength ? name+namelength+1 : name+namelength);
+
+    uint64_t offset = (uint64_t) (uint32_t) mvb_int(a, 0) | ((uint64_t) (uint32_t) mvb_int(a, 1) << 32);
+
+    bool success=(offset<=SIZE_MAX &&
+                  scene_addshared(r->scene, r->cobject, name, (size_t) offset, mvb_int(a, 2), format));
+    free(name);
+    return success;
+}
+
+/** Finds the function that processes a given command */
+static mvbfunction mvb_lookup(char command) {
+    switch (command) {
+        case 'S': return mvb_scene;
+        case 'W': return mvb_window;
+        case 'c': return mvb_color;
+        case 'C': return mvb_selectcolor;
+        case 'o': return mvb_object;
+        case 'v': return mvb_vertices;
+        case 'p': case 'l': case 'f': return mvb_index;
+        case 'd': return mvb_draw;
+        case 'i': return mvb_identity;
+        case 'm': return mvb_matrix;
+        case 'r': return mvb_rotate;
+        case 's': return mvb_scale;
+        case 't': return mvb_translate;
+        case 'F': return mvb_font;
+        case 'T': return mvb_text;
+        case 'M': return mvb_shared;
+    }
+    return NULL;
+}
+
+/* -------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------- */
+
+/** Checks whether data is in the .mvb format
+ *  @param[in] data - contents of the file
+ *  @param[in] length - length of the contents
+ *  @returns true if the data starts with the .mvb magic number */
+bool mvb_identify(const char *data, size_t length) {
+    return (length>=sizeof(mvbheader) && memcmp(data, MVB_MAGIC, MVB_MAGICLENGTH)==0);
+}
+
+/** Processes the records of an .mvb file, creating scenes as they are defined
+ *  @param[in] data - contents of the file, which should be aligned to at least MVB_ALIGN
+ *  @param[in] length - length of the contents
+ *  @param[in] sink - receives the scenes, or NULL
+ *  @returns true on success */
+bool mvb_parse(const char *data, size_t length, scenesink *sink) {
+    mvbreader r = { .scene = NULL, .sink = sink, .view = NULL, .modelchanged = false, .cobject = NULL };
+    mvbheader header;
+    mat3d_identity4x4(r.model);
+
+    if (!mvb_identify(data, length)) return false;
+    memcpy(&header, data, sizeof(mvbheader));
+
+    if (header.byteorder!=MVB_BYTEORDER) {
+        fprintf(stderr, "morphoview: Binary file has the wrong byte order.\n");
+        return false;
+    }
+
+    if (header.version!=MVB_VERSION) {
+        fprintf(stderr, "morphoview: Unsupported binary file version %u.\n", header.version);
+        return false;
+    }
+
+    size_t offset = sizeof(mvbheader);
+    while (offset<length) {
+        mvbrecord rec;
+        if (length-offset<sizeof(mvbrecord)) {
+            fprintf(stderr, "morphoview: Truncated binary file.\n");
+            return false;
+        }
+        memcpy(&rec, data+offset, sizeof(mvbrecord));
+        offset+=sizeof(mvbrecord);
+
+        uint64_t strsize = mvb_pad(rec.strlength);
+        uint64_t wordsize = mvb_pad(4*(uint64_t) rec.count);
+        if (strsize+wordsize > length-offset) {
+            fprintf(stderr, "morphoview: Truncated binary file.\n");
+            return false;
+        }
+
+        mvbargs args = { .command = (char) rec.command,
+                         .str = data+offset, .strlength = rec.strlength,
+                         .words = data+offset+strsize, .count = rec.count };
+        offset+=(size_t) (strsize+wordsize);
+
+        mvbfunction fn = mvb_lookup(args.command);
+        if (!fn) {
+            fprintf(stderr, "morphoview: Unrecognized record '%c' in binary file.\n", args.command);
+            return false;
+        }
+
+        ERRCHK((*fn) (&r, &args));
+    }
+
+    /** Prepare the scene for display */
+    if (r.scene) scene_sinkprepare(r.sink, r.view, r.scene);
+
+    return true;
+}
+
+/* -------------------------------------------------------
+ * Writer
+ * ------------------------------------------------------- */
+
+/** Writes zero padding following a block of the given length */
+static bool mvb_writepadding(FILE *f, uint64_t length) {
+    static const char zeros[MVB_ALIGN] = { 0 };
+    size_t npad = (size_t) (mvb_pad(length) - length);
+    return (npad==0 || fwrite(zeros, 1, npad, f)==npad);
+}
+
+/** Writes a record whose string argument may contain zero bytes
+ *  @param[in] f - file to write to
+ *  @param[in] command - the command character
+ *  @param[in] str - string argument, or NULL
+ *  @param[in] strlength - length of the string argument
+ *  @param[in] words - 32 bit words, or NULL if count is 0
+ *  @param[in] count - number of words
+ *  @returns true on success */
+static bool mvb_writerecordn(FILE *f, char command, const char *str, size_t strlength, const void *words, uint32_t count) {
+    mvbrecord rec;
+    memset(&rec, 0, sizeof(mvbrecord));
+    rec.command=(uint8_t) command;
+    rec.strlength=(uint32_t) (str ? strlength : 0);
+    rec.count=count;
+
+    return (fwrite(&rec, sizeof(mvbrecord), 1, f)==1 &&
+            (rec.strlength==0 || fwrite(str, 1, rec.strlength, f)==rec.strlength) &&
+            mvb_writepadding(f, rec.strlength) &&
+            (count==0 || fwrite(words, 4, count, f)==count) &&
+            mvb_writepadding(f, 4*(uint64_t) count));
+}
+
+/** Writes a record
+ *  @param[in] f - file to write to
+ *  @param[in] command - the command character
+ *  @param[in] str - string argument, or NULL
+ *  @param[in] words - 32 bit words, or NULL if count is 0
+ *  @param[in] count - number of words
+ *  @returns true on success */
+static bool mvb_writerecord(FILE *f, char command, const char *str, const void *words, uint32_t count) {
+    return mvb_writerecordn(f, command, str, (str ? strlen(str) : 0), words, count);
+}
+
+/** Writes a reference to data held in shared memory, so that the data is mapped again rather than copied */
+static bool mvb_writeshared(FILE *f, scene *s, void *data, int count, const char *format) {
+    sharedsegment *seg = scene_findsegment(s, data);
+    if (!seg) return false;
+
+    size_t namelength = strlen(seg->name), formatlength = strlen(format);
+    char *str = malloc(namelength+formatlength+2);
+    if (!str) return false;
+    memcpy(str, seg->name, namelength+1);
+    memcpy(str+namelength+1, format, formatlength+1);
+
+    uint64_t offset = (uint64_t) ((char *) data - seg->base);
+    uint32_t words[3] = { (uint32_t) offset, (uint32_t) (offset >> 32), (uint32_t) count };
+
+    bool success=mvb_writerecordn(f, 'M', str, namelength+formatlength+1, words, 3);
+    free(str);
+    return success;
+}
+
+/** Writes a record of integers held in the scene */
+static bool mvb_writeintarray(FILE *f, char command, int *data, uint32_t count) {
+    if (sizeof(int)==sizeof(int32_t)) return mvb_writerecord(f, command, NULL, data, count);
+
+    int32_t *words = malloc(sizeof(int32_t)*count);
+    if (!words) return false;
+    for (uint32_t i=0; i<count; i++) words[i]=(int32_t) data[i];
+
+    bool success=mvb_writerecord(f, command, NULL, words, count);
+    free(words);
+    return success;
+}
+
+/** Writes the model matrix used by a draw, so that the following draw record picks it up */
+static bool mvb_writemodel(FILE *f, scene *s, int matindx) {
+    if (matindx==SCENE_EMPTY) return true;
+    return (mvb_writerecord(f, 'i', NULL, NULL, 0) &&
+            mvb_writerecord(f, 'm', NULL, s->matrices.data[matindx].m, 16));
+}
+
+/** Writes an object's vertices and elements */
+static bool mvb_writeobject(FILE *f, scene *s, gobject *obj) {
+    int32_t id = obj->id;
+    ERRCHK(mvb_writerecord(f, 'o', NULL, &id, 1));
+
+    if (obj->vertexdata.shared) {
+        ERRCHK(mvb_writeshared(f, s, obj->vertexdata.shared, obj->vertexdata.length, (obj->vertexdata.format ? obj->vertexdata.format : "")));
+    } else if (obj->vertexdata.indx!=SCENE_EMPTY) {
+        ERRCHK(mvb_writerecord(f, 'v', obj->vertexdata.format, s->data.data+obj->vertexdata.indx, (uint32_t) obj->vertexdata.length));
+    }
+
+    for (unsigned int i=0; i<obj->elements.count; i++) {
+        gelement *el = &obj->elements.data[i];
+        char command = (el->type==FACETS ? 'f' : (el->type==LINES ? 'l' : 'p'));
+        if (el->shared) {
+            char format[2] = { command, '\0' };
+            ERRCHK(mvb_writeshared(f, s, el->shared, el->length, format));
+        } else {
+            int *indx = (el->length>0 ? s->indx.data+el->indx : NULL);
+            ERRCHK(mvb_writeintarray(f, command, indx, (uint32_t) el->length));
+        }
+    }
+
+    return true;
+}
+
+/** Writes the header of an .mvb file
+ *  @param[in] f - file to write to, opened in binary mode
+ *  @returns true on success */
+bool mvb_writeheader(FILE *f) {
+    mvbheader header;
+    memcpy(header.magic, MVB_MAGIC, MVB_MAGICLENGTH);
+    header.version=MVB_VERSION;
+    header.byteorder=MVB_BYTEORDER;
+    return (fwrite(&header, sizeof(mvbheader), 1, f)==1);
+}
+
+/** Writes a scene as a sequence of records, which recreate an equivalent scene when read back.
+ *  @details Definitions are written first, followed by the display list; model matrices are written in full before
+ *           the draw that uses them rather than as the transformations that built them.
+ *  @param[in] f - file to write to, following the header
+ *  @param[in] s - the scene
+ *  @param[in] title - window title, or NULL
+ *  @returns true on success */
+bool mvb_writescene(FILE *f, scene *s, const char *title) {
+    int32_t header[2] = { s->id, s->dim };
+    ERRCHK(mvb_writerecord(f, 'S', NULL, header, 2));
+    if (title) ERRCHK(mvb_writerecord(f, 'W', title, NULL, 0));
+
+    for (unsigned int i=0; i<s->fontlist.count; i++) {
+        gfont *font = &s->fontlist.data[i];
+        int32_t words[2] = { font->id, 0 };
+        memcpy(words+1, &font->size, sizeof(float));
+        ERRCHK(mvb_writerecord(f, 'F', font->file, words, 2));
+    }
+
+    for (unsigned int i=0; i<s->colorlist.count; i++) {
+        gcolor *color = &s->colorlist.data[i];
+        uint32_t count = 1+3*(uint32_t) color->length;
+        int32_t *words = malloc(sizeof(int32_t)*count);
+        if (!words) return false;
+
+        words[0]=color->colorid;
+        memcpy(words+1, s->colors.data+color->indx, sizeof(float)*(count-1));
+        bool success=mvb_writerecord(f, 'c', NULL, words, count);
+        free(words);
+        ERRCHK(success);
+    }
+
+    for (unsigned int i=0; i<s->objectlist.count; i++) {
+        ERRCHK(mvb_writeobject(f, s, &s->objectlist.data[i]));
+    }
+
+    for (unsigned int i=0; i<s->displaylist.count; i++) {
+        gdraw *drw = &s->displaylist.data[i];
+        int32_t id = drw->id;
+
+        switch (drw->type) {
+            case OBJECT:
+                ERRCHK(mvb_writemodel(f, s, drw->matindx));
+                ERRCHK(mvb_writerecord(f, 'd', NULL, &id, 1));
+                break;
+            case TEXT:
+            {
+                gtext *txt = &s->textlist.data[drw->id];
+                int32_t fontid = txt->fontid;
+                ERRCHK(mvb_writemodel(f, s, drw->matindx));
+                ERRCHK(mvb_writerecord(f, 'T', txt->text, &fontid, 1));
+            }
+                break;
+            case COLOR:
+                ERRCHK(mvb_writerecord(f, 'C', NULL, &id, 1));
+                break;
+        }
+    }
+
+    return true;
+}
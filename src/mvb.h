@@ -0,0 +1,94 @@
+/** @file mvb.h
+ *  @author T J Atherton
+ *
+ *  @brief Binary scene format for morphoview
+ */
+
+#ifndef mvb_h
+#define mvb_h
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "scene.h"
+
+/* -------------------------------------------------------
+ * The .mvb format
+ * -------------------------------------------------------
+ *
+ * An .mvb file holds the same commands as the text command language, but with numerical data stored as 32 bit
+ * integers and floats in the byte order of the machine that wrote it. It consists of a 16 byte header followed
+ * by a sequence of records.
+ *
+ * Header:  bytes 0-7    magic number MVB_MAGIC
+ *          bytes 8-11   uint32 version, MVB_VERSION
+ *          bytes 12-15  uint32 byte order marker, MVB_BYTEORDER
+ *
+ * Record:  byte  0      command character, as in the command language
+ *          bytes 1-3    reserved, zero
+ *          bytes 4-7    uint32 length in bytes of the string argument, excluding padding
+ *          bytes 8-11   uint32 number of 32 bit words following the string
+ *          bytes 12-15  reserved, zero
+ *          then the string, zero padded to a multiple of 16 bytes,
+ *          then the words, zero padded to a multiple of 16 bytes.
+ *
+ * Every record and payload therefore begins on a 16 byte boundary, so that vertex and index blocks in a mapped
+ * file are aligned to be copied, or uploaded to the GPU, directly. Arguments for each command are:
+ *
+ *  Command     String      Words
+ *  S           -           int32 id, int32 dim
+ *  W           title       -
+ *  c           -           int32 id, float rgb[3n]
+ *  C           -           int32 id
+ *  o           -           int32 id
+ *  v           format*     float data[]
+ *  p, l, f     -           int32 indices[]
+ *  d           -           int32 id
+ *  i           -           -
+ *  m           -           float matrix[16]
+ *  r           -           float angle, float axis[3]
+ *  s           -           float scale
+ *  t           -           float x[3]
+ *  F           file        int32 id, float size
+ *  T           text        int32 fontid
+ *  M           segment**   uint32 offset[2], int32 count
+ *
+ *  * An empty format leaves the format of the current object unchanged.
+ *  ** The name of the shared memory segment, then a zero byte, then the format; see the M command. The offset is in
+ *     bytes, with its low word first. */
+
+#define MVB_MAGIC "\x89MVB\r\n\x1a\n"
+#define MVB_MAGICLENGTH 8
+#define MVB_VERSION 1
+#define MVB_BYTEORDER 0x01020304
+
+#define MVB_ALIGN 16
+
+/** @brief Header of an .mvb file */
+typedef struct {
+    char magic[MVB_MAGICLENGTH];
+    uint32_t version;
+    uint32_t byteorder;
+} mvbheader;
+
+/** @brief Header of a record */
+typedef struct {
+    uint8_t command;
+    uint8_t reserved[3];
+    uint32_t strlength;
+    uint32_t count;
+    uint32_t reserved2;
+} mvbrecord;
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+bool mvb_identify(const char *data, size_t length);
+bool mvb_parse(const char *data, size_t length, scenesink *sink);
+
+bool mvb_writeheader(FILE *f);
+bool mvb_writescene(FILE *f, scene *s, const char *title);
+
+#endif /* mvb_h */
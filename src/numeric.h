@@ -0,0 +1,22 @@
+/** @file numeric.h
+ *  @author T J Atherton
+ *
+ *  @brief Locale independent conversion of numbers in the command language
+ */
+
+#ifndef numeric_h
+#define numeric_h
+
+#include <stdbool.h>
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+const char *numeric_scaninteger(const char *start, const char *end, int *out);
+const char *numeric_scanfloat(const char *start, const char *end, float *out);
+
+bool numeric_parseinteger(const char *start, unsigned int length, int *out);
+bool numeric_parsefloat(const char *start, unsigned int length, float *out);
+
+#endif /* numeric_h */
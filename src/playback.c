@@ -0,0 +1,454 @@
+/** @file playback.c
+ *  @author T J Atherton
+ *
+ *  @brief Plays a sequence of command files as the frames of an animation
+ *  @details The first frame is prepared as usual, and its elements, colors, transformations and text are used for the
+ *           whole sequence; later frames supply only vertex data, and must draw the same objects with the same
+ *           numbers of vertices and elements. Frames are parsed ahead of the one shown on a background thread, and
+ *           their vertex data uploaded into a ring of vertex buffers that share the first frame's element buffers,
+ *           so playing, stepping and scrubbing never wait for a frame: the last frame ready is shown until the next
+ *           arrives. Positions may be interpolated on the GPU between consecutive frames while playing.
+ *
+ *           Keys: space plays or pauses, '.' and ',' step forwards and backwards, ']' and '[' scrub, Home and End
+ *           go to the first and last frames and 'I' turns interpolation on or off.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "playback.h"
+#include "command.h"
+#include "cache.h"
+#include "display.h"
+
+#ifdef PLAYBACK_THREAD
+#include <pthread.h>
+#endif
+
+/* -------------------------------------------------------
+ * Parse frames
+ * ------------------------------------------------------- */
+
+/** @brief Scenes read from a frame's file; only the first is used */
+typedef struct {
+    scene *first;
+    scene *extra; /** Most recent other scene, freed once the parser has moved on from it */
+} playbackscenes;
+
+static void *playback_sinkopen(void *ref, scene *s) {
+    playbackscenes *scenes = (playbackscenes *) ref;
+    
+    if (!scenes->first) {
+        scenes->first=s;
+    } else {
+        if (scenes->extra) scene_free(scenes->extra);
+        scenes->extra=s;
+    }
+    return NULL;
+}
+
+/** Parses the file holding a frame
+ *  @returns the frame's first scene, or NULL on failure */
+static scene *playback_parse(const char *file, bool cache) {
+    playbackscenes scenes = { .first = NULL, .extra = NULL };
+    scenesink sink = { .open = playback_sinkopen, .ref = &scenes };
+    commandinput input;
+    
+    bool success=command_loadinput(file, &input);
+    if (success) {
+        success=(cache ? cache_parseinput(&input, &sink) : command_parseinput(&input, &sink));
+        command_freeinput(&input);
+    }
+    
+    if (scenes.extra) scene_free(scenes.extra);
+    if (!success && scenes.first) {
+        scene_free(scenes.first);
+        scenes.first=NULL;
+    }
+    
+    return scenes.first;
+}
+
+/* -------------------------------------------------------
+ * Loader
+ * ------------------------------------------------------- */
+
+/** @brief A frame parsed ahead of the frame shown */
+typedef struct {
+    int frame; /** Frame held, or -1 */
+    scene *s; /** The frame's scene, or NULL if it couldn't be parsed */
+} playbackslot;
+
+/** @brief Parses the frames following the frame shown */
+typedef struct {
+    const char **files;
+    int nframes;
+    bool cache;
+    
+    playbackslot slots[PLAYBACK_AHEAD];
+    int want; /** Frame shown; frames are parsed in order from here, continuing from the first after the last */
+    bool quit; /** Set to stop the loader */
+
+#ifdef PLAYBACK_THREAD
+    pthread_t thread;
+    pthread_mutex_t lock; /** Protects slots, want and quit */
+    pthread_cond_t wake; /** Signalled when want or quit change */
+    bool threaded; /** Whether the thread is running */
+#endif
+} playbackloader;
+
+static void playback_lock(playbackloader *l) {
+#ifdef PLAYBACK_THREAD
+    if (l->threaded) pthread_mutex_lock(&l->lock);
+#endif
+}
+
+static void playback_unlock(playbackloader *l) {
+#ifdef PLAYBACK_THREAD
+    if (l->threaded) pthread_mutex_unlock(&l->lock);
+#endif
+}
+
+/** Checks whether a frame is among those that should be parsed ahead */
+static bool playback_inwindow(playbackloader *l, int frame) {
+    int ahead = (l->nframes<PLAYBACK_AHEAD ? l->nframes : PLAYBACK_AHEAD);
+    return ((frame-l->want+l->nframes)%l->nframes < ahead);
+}
+
+/** Finds the slot holding a frame, or NULL */
+static playbackslot *playback_findslot(playbackloader *l, int frame) {
+    for (int i=0; i<PLAYBACK_AHEAD; i++) {
+        if (l->slots[i].frame==frame) return &l->slots[i];
+    }
+    return NULL;
+}
+
+/** Finds the next frame to parse, or -1 if all those ahead have been parsed */
+static int playback_nextframe(playbackloader *l) {
+    if (l->quit) return -1;
+    
+    for (int i=0; i<PLAYBACK_AHEAD && i<l->nframes; i++) {
+        int frame = (l->want+i)%l->nframes;
+        if (!playback_findslot(l, frame)) return frame;
+    }
+    return -1;
+}
+
+/** Stores a parsed frame in place of one no longer needed
+ *  @returns a scene to be freed, or NULL */
+static scene *playback_store(playbackloader *l, int frame, scene *s) {
+    if (!playback_inwindow(l, frame) || playback_findslot(l, frame)) return s; /* Moved on while parsing */
+    
+    for (int i=0; i<PLAYBACK_AHEAD; i++) {
+        playbackslot *slot = &l->slots[i];
+        if (slot->frame<0 || !playback_inwindow(l, slot->frame)) {
+            scene *old = slot->s;
+            slot->frame=frame;
+            slot->s=s;
+            return old;
+        }
+    }
+    return s;
+}
+
+/** Parses the next frame needed, if any
+ *  @returns true if a frame was parsed */
+static bool playback_loadnext(playbackloader *l) {
+    playback_lock(l);
+    int frame = playback_nextframe(l);
+    playback_unlock(l);
+    if (frame<0) return false;
+    
+    scene *s = playback_parse(l->files[frame], l->cache);
+    if (!s) fprintf(stderr, "morphoview: Couldn't read frame %s.\n", l->files[frame]);
+    
+    /* Scenes are freed on the loader's thread, as fonts are opened and closed there */
+    playback_lock(l);
+    scene *old = playback_store(l, frame, s);
+    playback_unlock(l);
+    
+    if (old) scene_free(old);
+    return true;
+}
+
+#ifdef PLAYBACK_THREAD
+/** Parses frames ahead of the one shown until told to quit */
+static void *playback_loader(void *ref) {
+    playbackloader *l = (playbackloader *) ref;
+    
+    for (;;) {
+        if (playback_loadnext(l)) continue;
+        
+        pthread_mutex_lock(&l->lock);
+        while (!l->quit && playback_nextframe(l)<0) pthread_cond_wait(&l->wake, &l->lock);
+        bool quit=l->quit;
+        pthread_mutex_unlock(&l->lock);
+        
+        if (quit) break;
+    }
+    
+    return NULL;
+}
+#endif
+
+/** Initializes a loader, starting its thread where available */
+static void playback_loaderinit(playbackloader *l, int nframes, const char **files, bool cache) {
+    l->files=files;
+    l->nframes=nframes;
+    l->cache=cache;
+    l->want=0;
+    l->quit=false;
+    
+    for (int i=0; i<PLAYBACK_AHEAD; i++) {
+        l->slots[i].frame=-1;
+        l->slots[i].s=NULL;
+    }
+
+#ifdef PLAYBACK_THREAD
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->wake, NULL);
+    /* The thread takes the lock from the start */
+    l->threaded=true;
+    if (pthread_create(&l->thread, NULL, playback_loader, l)!=0) l->threaded=false;
+#endif
+}
+
+/** Stops a loader and frees the frames it holds */
+static void playback_loaderclear(playbackloader *l) {
+#ifdef PLAYBACK_THREAD
+    if (l->threaded) {
+        pthread_mutex_lock(&l->lock);
+        l->quit=true;
+        pthread_cond_signal(&l->wake);
+        pthread_mutex_unlock(&l->lock);
+        
+        pthread_join(l->thread, NULL);
+        l->threaded=false;
+    }
+    pthread_mutex_destroy(&l->lock);
+    pthread_cond_destroy(&l->wake);
+#endif
+    
+    for (int i=0; i<PLAYBACK_AHEAD; i++) {
+        if (l->slots[i].s) scene_free(l->slots[i].s);
+        l->slots[i].frame=-1;
+        l->slots[i].s=NULL;
+    }
+}
+
+/** Tells the loader which frame is shown, so that it parses the frames that follow */
+static void playback_setwant(playbackloader *l, int frame) {
+    playback_lock(l);
+    if (l->want!=frame) {
+        l->want=frame;
+#ifdef PLAYBACK_THREAD
+        if (l->threaded) pthread_cond_signal(&l->wake);
+#endif
+    }
+    playback_unlock(l);
+}
+
+/** Gives a loader without a thread the opportunity to parse a frame */
+static void playback_loaderupdate(playbackloader *l) {
+#ifdef PLAYBACK_THREAD
+    if (l->threaded) return;
+#endif
+    playback_loadnext(l);
+}
+
+/* -------------------------------------------------------
+ * Player
+ * ------------------------------------------------------- */
+
+/** @brief Shows frames as they become ready */
+typedef struct {
+    display *d;
+    playbackloader *loader;
+    int nframes;
+    
+    int frame; /** Frame shown */
+    double position; /** Position in the sequence, in frames */
+    double time; /** Time of the last update */
+    bool playing;
+    bool interpolate; /** Whether to interpolate positions between frames while playing */
+    
+    int ring[RENDER_FRAMERING]; /** Frame held by each slot of the renderer's frame ring, or -1 */
+    bool valid[RENDER_FRAMERING]; /** Whether each frame held could be uploaded */
+    int titled; /** Frame named in the window title */
+} playbackplayer;
+
+/** Uploads a frame into its slot of the frame ring, if it has been parsed
+ *  @returns true if the frame is in the ring */
+static bool playback_fetch(playbackplayer *p, int frame) {
+    int slot = frame%RENDER_FRAMERING;
+    if (p->ring[slot]==frame) return true;
+    
+    bool found=false;
+    playback_lock(p->loader);
+    playbackslot *parsed = playback_findslot(p->loader, frame);
+    if (parsed) {
+        p->ring[slot]=frame;
+        p->valid[slot]=(parsed->s && render_uploadframe(&p->d->render, slot, parsed->s));
+        if (parsed->s && !p->valid[slot]) {
+            fprintf(stderr, "morphoview: Frame %s doesn't match the first frame.\n", p->loader->files[frame]);
+        }
+        found=true;
+    }
+    playback_unlock(p->loader);
+    
+    return found;
+}
+
+/** Names the frame shown in the window title */
+static void playback_title(playbackplayer *p) {
+    if (p->titled==p->frame) return;
+    
+    char title[1024];
+    snprintf(title, sizeof(title), "%s (%i/%i)", p->loader->files[p->frame], p->frame+1, p->nframes);
+    display_setwindowtitle(p->d, title);
+    p->titled=p->frame;
+}
+
+/** Advances playback and shows the frame reached, once it is ready
+ *  @returns how long to wait for events before advancing again, in seconds, or DISPLAY_WAITFOREVER */
+static double playback_advance(playbackplayer *p) {
+    double t = glfwGetTime();
+    if (p->playing) {
+        p->position+=(t-p->time)*PLAYBACK_FRAMERATE;
+        if (p->position>=p->nframes) p->position=fmod(p->position, p->nframes);
+    }
+    p->time=t;
+    
+    int target = (int) p->position;
+    playback_setwant(p->loader, target);
+    playback_loaderupdate(p->loader);
+    
+    /* Keep the frames that follow in the ring, so that positions can be interpolated and playing doesn't wait */
+    glfwMakeContextCurrent(p->d->window);
+    bool filled=true;
+    for (int i=0; i<RENDER_FRAMERING && target+i<p->nframes && filled; i++) {
+        filled=playback_fetch(p, target+i);
+
+        /* A frame that can't be shown leaves the one before it on screen, whose slot the frames after it would reuse */
+        if (filled && !p->valid[(target+i)%RENDER_FRAMERING]) break;
+    }
+    
+    int slot = target%RENDER_FRAMERING, next = (slot+1)%RENDER_FRAMERING;
+    renderer *r = &p->d->render;
+    
+    if (p->ring[slot]!=target) { /* Hold the frame shown until the target is ready */
+        if (p->playing) p->position=target;
+        if (r->blend!=0.0f) display_redraw(p->d);
+        r->blend=0.0f;
+        return PLAYBACK_POLLINTERVAL;
+    }
+    
+    p->frame=target;
+    bool interpolate=false;
+    if (p->valid[slot]) {
+        interpolate = (p->interpolate && p->playing && target+1<p->nframes && p->ring[next]==target+1 && p->valid[next]);
+        float blend = (interpolate ? (float) (p->position-target) : 0.0f);
+        if (r->frame!=slot || r->blend!=blend) display_redraw(p->d);
+        r->frame=slot;
+        r->blend=blend;
+    }
+    
+    playback_title(p);
+    
+    /* Interpolated frames change continuously; otherwise nothing changes until the next frame is due */
+    if (!filled) return PLAYBACK_POLLINTERVAL;
+    if (!p->playing) return DISPLAY_WAITFOREVER;
+    if (interpolate) return 0.0;
+    return (target+1-p->position)/PLAYBACK_FRAMERATE;
+}
+
+/** Moves to a frame, which is shown once it is ready */
+static void playback_seek(playbackplayer *p, int frame) {
+    if (frame<0) frame=0;
+    if (frame>=p->nframes) frame=p->nframes-1;
+    p->position=frame;
+}
+
+/** Playback controls */
+static bool playback_key(void *ref, int key, int mods) {
+    playbackplayer *p = (playbackplayer *) ref;
+    int scrub = (int) (PLAYBACK_SCRUB*p->nframes);
+    if (scrub<1) scrub=1;
+    
+    switch (key) {
+        case GLFW_KEY_SPACE: p->playing=!p->playing; break;
+        case GLFW_KEY_PERIOD: p->playing=false; playback_seek(p, (int) p->position+1); break;
+        case GLFW_KEY_COMMA: p->playing=false; playback_seek(p, (int) p->position-1); break;
+        case GLFW_KEY_RIGHT_BRACKET: playback_seek(p, (int) p->position+scrub); break;
+        case GLFW_KEY_LEFT_BRACKET: playback_seek(p, (int) p->position-scrub); break;
+        case GLFW_KEY_HOME: playback_seek(p, 0); break;
+        case GLFW_KEY_END: playback_seek(p, p->nframes-1); break;
+        case GLFW_KEY_I: p->interpolate=!p->interpolate; break;
+        default: return false;
+    }
+    
+    return true;
+}
+
+/** Initializes a player for a display showing the first frame */
+static void playback_playerinit(playbackplayer *p, display *d, playbackloader *l, int nframes) {
+    p->d=d;
+    p->loader=l;
+    p->nframes=nframes;
+    p->frame=0;
+    p->position=0.0;
+    p->time=glfwGetTime();
+    p->playing=false;
+    p->interpolate=true;
+    p->titled=-1;
+    
+    for (int i=0; i<RENDER_FRAMERING; i++) {
+        p->ring[i]=-1;
+        p->valid[i]=false;
+    }
+}
+
+/* -------------------------------------------------------
+ * Playback
+ * ------------------------------------------------------- */
+
+/** Plays a sequence of command files as the frames of an animation, until the window is closed
+ *  @param[in] nframes - number of frames
+ *  @param[in] files - the command file for each frame
+ *  @param[in] cache - whether to reuse scenes cached from an earlier run
+ *  @returns true on success */
+bool playback_run(int nframes, const char **files, bool cache) {
+    if (nframes<1) return false;
+    
+    scene *first = playback_parse(files[0], cache);
+    if (!first) {
+        fprintf(stderr, "morphoview: Couldn't read frame %s.\n", files[0]);
+        return false;
+    }
+    
+    display *d = display_open(first);
+    if (!d) {
+        scene_free(first);
+        return false;
+    }
+    display_refresh(d);
+    
+    playbackloader loader;
+    playback_loaderinit(&loader, nframes, files, cache);
+    
+    playbackplayer player;
+    playback_playerinit(&player, d, &loader, nframes);
+    display_setkeyfn(d, playback_key, &player);
+    playback_title(&player);
+    
+    double wait=0.0;
+    while (!glfwWindowShouldClose(d->window) && display_wait(wait)) wait=playback_advance(&player);
+    
+    /* Stop the loader before the window's scene is freed, as fonts are opened and closed on the loader's thread */
+    playback_loaderclear(&loader);
+    display_update();
+    
+    return true;
+}
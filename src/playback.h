@@ -0,0 +1,35 @@
+/** @file playback.h
+ *  @author T J Atherton
+ *
+ *  @brief Plays a sequence of command files as the frames of an animation
+ */
+
+#ifndef playback_h
+#define playback_h
+
+#include <stdbool.h>
+
+/** Parse frames on a background thread where available; elsewhere they are parsed between updates of the display */
+#ifndef _WIN32
+#define PLAYBACK_THREAD
+#endif
+
+/** Number of frames parsed ahead of the frame shown; at least RENDER_FRAMERING */
+#define PLAYBACK_AHEAD 8
+
+/** Frames shown per second while playing */
+#define PLAYBACK_FRAMERATE 10.0
+
+/** Fraction of the sequence moved by each scrub */
+#define PLAYBACK_SCRUB 0.1
+
+/** Interval in seconds between checks for frames that are still being parsed */
+#define PLAYBACK_POLLINTERVAL 0.01
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+bool playback_run(int nframes, const char **files, bool cache);
+
+#endif /* playback_h */
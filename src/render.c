@@ -6,6 +6,7 @@
 
 #include <string.h>
 #include "render.h"
+#include "hash.h"
 
 /* -------------------------------------------------------
  * Varrays
@@ -18,29 +19,69 @@ DEFINE_VARRAY(renderfont, renderfont)
 DEFINE_VARRAY(renderglbuffers, renderglbuffers)
 
 DEFINE_VARRAY(renderinstruction, renderinstruction)
+DEFINE_VARRAY(renderuniforms, renderuniforms)
+DEFINE_VARRAY(renderoffset, void *)
+
+/** @brief A draw found in the render list, with the state it is drawn in */
+typedef struct {
+    renderinstruction ins; /* The draw itself */
+    GLuint array; /* Vertex array bound */
+    renderobject *obj; /* Object the vertex array belongs to, whose buffers hold the frame ring */
+    int model; /* Model matrix selected, or -1 for the identity */
+    unsigned int order; /* Position in the render list, which orders draws made in the same state */
+} renderdraw;
+
+DECLARE_VARRAY(renderdraw, renderdraw)
+DEFINE_VARRAY(renderdraw, renderdraw)
 
 /* -------------------------------------------------------
  * Shaders
  * ------------------------------------------------------- */
 
+/* Uniform blocks shared by the shaders; these must match renderframe and renderuniforms */
+
+#define RENDER_STRINGIFY(x) #x
+#define RENDER_STRING(x) RENDER_STRINGIFY(x)
+
+#define RENDER_FRAMEBLOCK \
+    "layout (std140) uniform Frame {" \
+    "   mat4 view;" \
+    "   mat4 proj;" \
+    "   vec3 lightColor;" \
+    "   vec3 lightPos;" \
+    "   vec3 viewPos;" \
+    "};"
+
+#define RENDER_DRAWSBLOCK \
+    "struct Transform {" \
+    "   mat4 modelview;" \
+    "   mat3 normalmatrix;" /* Inverse transpose of modelview */ \
+    "};" \
+    "layout (std140) uniform Draws {" \
+    "   Transform transforms[" RENDER_STRING(RENDER_DRAWBLOCK) "];" \
+    "};" \
+    "uniform int drawindex;" /* Entry of the block for the current model matrix */
+
 /* Default shader */
 
 const char *vertexshader = "#version 330 core\n"
     "layout (location = 0) in vec3 vPos;"
     "layout (location = 1) in vec3 vColor;"
     "layout (location = 2) in vec3 vNormal;"
+    "layout (location = 3) in vec3 vNext;" // Position in the next frame of a sequence
     "out vec3 fragColor;"
     "out vec3 fragPos;"
     "out vec3 normal;"
-    "uniform mat4 model;"
-    "uniform mat4 view;"
-    "uniform mat4 proj;"
+    RENDER_FRAMEBLOCK
+    RENDER_DRAWSBLOCK
+    "uniform float blend;"
 
     "void main() {"
-    "   gl_Position = proj * view * model * vec4(vPos, 1.0);"
+    "   vec3 pos = mix(vPos, vNext, blend);"
+    "   gl_Position = proj * transforms[drawindex].modelview * vec4(pos, 1.0);"
     "   fragColor = vColor;"
-    "   fragPos = vPos;"
-    "   normal = mat3(transpose(inverse(view * model))) * vNormal;"
+    "   fragPos = pos;"
+    "   normal = transforms[drawindex].normalmatrix * vNormal;"
     "}";
 
 const char *fragmentshader = "#version 330 core\n"
@@ -48,9 +89,7 @@ const char *fragmentshader = "#version 330 core\n"
     "in vec3 fragColor;"
     "in vec3 fragPos;"
     "in vec3 normal;"
-    "uniform vec3 lightColor;"
-    "uniform vec3 lightPos;"
-    "uniform vec3 viewPos;"
+    RENDER_FRAMEBLOCK
     ""
     "void main() {"
     "   float ambientStrength = 0.1;"
@@ -102,13 +141,11 @@ const char *textvertexshader =
     "layout (location = 0) in vec3 vertex;"
     "layout (location = 1) in vec2 tex;"
     "out vec2 TexCoords;"
-
-    "uniform mat4 model;"
-    "uniform mat4 view;"
-    "uniform mat4 proj;"
+    RENDER_FRAMEBLOCK
+    RENDER_DRAWSBLOCK
 
     "void main() {"
-    "    gl_Position = proj * view * model * vec4(vertex, 1.0);"
+    "    gl_Position = proj * transforms[drawindex].modelview * vec4(vertex, 1.0);"
     "    TexCoords = tex;"
     "}";
 
@@ -191,39 +228,150 @@ bool render_compileprogram(const char *vertexshadersource, const char *fragments
  * Initialize/finalize display
  * ------------------------------------------------------- */
 
-/** Initializes a display, compiling shaders */
+/* Displays share their OpenGL objects, so shader programs are compiled once and kept while any renderer uses them */
+static GLuint sharedshader, sharedtextshader;
+static int sharedusers = 0;
+
+/** Assigns a program's uniform blocks to their binding points */
+static void render_bindblocks(GLuint program) {
+    GLuint frame = glGetUniformBlockIndex(program, "Frame");
+    GLuint draws = glGetUniformBlockIndex(program, "Draws");
+    if (frame!=GL_INVALID_INDEX) glUniformBlockBinding(program, frame, RENDER_FRAMEBINDING);
+    if (draws!=GL_INVALID_INDEX) glUniformBlockBinding(program, draws, RENDER_DRAWBINDING);
+}
+
+/** Initializes a display, compiling shaders unless another renderer has already */
 bool render_init(renderer *r) {
+    if (sharedusers==0) {
+        render_compileprogram(vertexshader, fragmentshader, &sharedshader);
+        render_compileprogram(textvertexshader, textfragmentshader, &sharedtextshader);
+        render_bindblocks(sharedshader);
+        render_bindblocks(sharedtextshader);
+    }
+    sharedusers++;
     
-    render_compileprogram(vertexshader, fragmentshader, &r->shader);
-    render_compileprogram(textvertexshader, textfragmentshader, &r->textshader);
+    r->shader=sharedshader;
+    r->textshader=sharedtextshader;
     
     /* Enable OpenGL features */
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_MULTISAMPLE);
 
+    render_initlayout(r);
+    
+    /* Uniforms outside the blocks are located once */
+    r->blenduniform=glGetUniformLocation(r->shader, "blend");
+    r->drawuniform=glGetUniformLocation(r->shader, "drawindex");
+    r->textcoloruniform=glGetUniformLocation(r->textshader, "textColor");
+    r->textdrawuniform=glGetUniformLocation(r->textshader, "drawindex");
+    
+    /* Buffers for the uniform blocks; blocks of transforms must start at multiples of the alignment required */
+    glGenBuffers(1, &r->frameubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, r->frameubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(renderframe), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    
+    glGenBuffers(1, &r->drawubo);
+    
+    GLint align=1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+    if (align<1) align=1;
+    r->drawstride=((RENDER_DRAWBLOCK*sizeof(renderuniforms)+align-1)/align)*align;
+    
+    return true;
+}
+
+/** Initializes a renderer's lists without compiling shaders, e.g. to lay out a scene without a display */
+void render_initlayout(renderer *r) {
     varray_renderobjectinit(&r->objects);
     varray_renderfontinit(&r->fonts);
     varray_renderglbuffersinit(&r->glbuffers);
     varray_renderinstructioninit(&r->renderlist);
-    
-    return true;
+    varray_renderinstructioninit(&r->geometry);
+    varray_renderinstructioninit(&r->text);
+    varray_intinit(&r->rangelengths);
+    varray_renderoffsetinit(&r->rangeoffsets);
+    varray_intinit(&r->rangebasevertices);
+    idmap_init(&r->objectmap);
+    idmap_init(&r->buffermap);
+    idmap_init(&r->fontmap);
+    r->fontvao=0;
+    r->fontvbo=0;
+    r->matrices=NULL;
+    r->ndraws=0;
+    r->ntexts=0;
+    r->frame=-1;
+    r->blend=0.0f;
+    varray_renderuniformsinit(&r->uniforms);
+    r->uniformsvalid=false;
+    r->frameubo=0;
+    r->drawubo=0;
+    r->drawubosize=0;
+    r->drawstride=0;
+    r->profile=(renderprofile) { .query = 0 };
 }
 
-void render_clear(renderer *r) {
+/** Frees the lists of a renderer initialized with render_initlayout, which holds no OpenGL objects */
+void render_clearlayout(renderer *r) {
+    varray_renderglbuffersclear(&r->glbuffers);
+    varray_renderfontclear(&r->fonts);
+    varray_renderobjectclear(&r->objects);
+    varray_renderinstructionclear(&r->renderlist);
+    varray_renderinstructionclear(&r->geometry);
+    varray_renderinstructionclear(&r->text);
+    varray_intclear(&r->rangelengths);
+    varray_renderoffsetclear(&r->rangeoffsets);
+    varray_intclear(&r->rangebasevertices);
+    idmap_clear(&r->objectmap);
+    idmap_clear(&r->buffermap);
+    idmap_clear(&r->fontmap);
+    varray_renderuniformsclear(&r->uniforms);
+    r->uniformsvalid=false;
+}
+
+/** Discards everything prepared from a scene, keeping the compiled shaders, so that the scene can be prepared again */
+void render_reset(renderer *r) {
     for (unsigned int i=0; i<r->glbuffers.count; i++) {
         renderglbuffers *b=&r->glbuffers.data[i];
         
         glDeleteVertexArrays(1, &b->array);
         glDeleteBuffers(1, &b->buffer);
         glDeleteBuffers(1, &b->element);
+        glDeleteVertexArrays(RENDER_FRAMERING, b->framearray);
+        glDeleteBuffers(RENDER_FRAMERING, b->framebuffer);
     }
     
-    varray_renderglbuffersclear(&r->glbuffers);
-    varray_renderfontclear(&r->fonts);
-    varray_renderobjectclear(&r->objects);
-    varray_renderinstructionclear(&r->renderlist);
+    for (unsigned int i=0; i<r->fonts.count; i++) {
+        glDeleteTextures(1, &r->fonts.data[i].texture);
+    }
     
-    glDeleteProgram(r->shader);
+    if (r->fontvao) glDeleteVertexArrays(1, &r->fontvao);
+    if (r->fontvbo) glDeleteBuffers(1, &r->fontvbo);
+    r->fontvao=0;
+    r->fontvbo=0;
+    
+    render_clearlayout(r);
+    r->matrices=NULL;
+    r->ndraws=0;
+    r->ntexts=0;
+    r->frame=-1;
+}
+
+/** Frees everything held by a renderer, deleting the shader programs once no other renderer uses them */
+void render_clear(renderer *r) {
+    render_reset(r);
+    if (r->profile.query) glDeleteQueries(1, &r->profile.query);
+    r->profile.query=0;
+    glDeleteBuffers(1, &r->frameubo);
+    glDeleteBuffers(1, &r->drawubo);
+    r->frameubo=0;
+    r->drawubo=0;
+    r->drawubosize=0;
+    
+    if (--sharedusers==0) {
+        glDeleteProgram(r->shader);
+        glDeleteProgram(r->textshader);
+    }
 }
 
 
@@ -261,7 +409,8 @@ void render_preparefonts(renderer *r, scene *scene) {
         renderfont font;
         font.font=&f->font;
         render_fonttexture(r, &f->font, &font.texture);
-        varray_renderfontwrite(&r->fonts, font);
+        int rfontid=varray_renderfontwrite(&r->fonts, font);
+        if (rfontid>=0) idmap_insert(&r->fontmap, (uint64_t) (uintptr_t) font.font, rfontid);
     }
     
     glGenVertexArrays(1, &r->fontvao);
@@ -285,7 +434,7 @@ void render_preparetext(renderer *r, scene *s, gdraw *drw, GLuint *carray) {
     /* Change the model matrix if provided */
     if (drw->matindx!=SCENE_EMPTY) {
         renderinstruction ins = { .instruction = RMODEL,
-                                  .data.model.model = &s->data.data[drw->matindx],
+                                  .data.model.indx = drw->matindx,
                                   .obj=NULL };
         varray_renderinstructionwrite(&r->renderlist, ins);
     }
@@ -297,10 +446,7 @@ void render_preparetext(renderer *r, scene *s, gdraw *drw, GLuint *carray) {
     if (!font) return;
     
     int rfontid;
-    for (rfontid=0; rfontid<r->fonts.count; rfontid++) {
-        if (r->fonts.data[rfontid].font==font) break;
-    }
-    if (rfontid>=r->fonts.count) return;
+    if (!idmap_get(&r->fontmap, (uint64_t) (uintptr_t) font, &rfontid)) return;
     
     renderinstruction ins = { .instruction = RTEXT,
                               .data.text.txt = txt->text,
@@ -387,52 +533,57 @@ void render_renderfonttextureatlas(renderer *r, int rfontid) {
  * Object rendering
  * ------------------------------------------------------- */
 
-/** Checks if an object is present in the render object list */
-renderobject *render_findrenderobject(varray_renderobject *list, gobject *obj) {
-    for (unsigned int i=0; i<list->count; i++) {
-        if (list->data[i].obj==obj) return &list->data[i];
-    }
+/** Finds a render object based on an object id */
+renderobject *render_findrenderobjectwithid(renderer *r, int id) {
+    int i;
+    if (idmap_get(&r->objectmap, (uint64_t) id, &i)) return &r->objects.data[i];
     return NULL;
 }
 
-/** Finds a render object based on an object id */
-renderobject *render_findrenderobjectwithid(varray_renderobject *list, int id) {
-    for (unsigned int i=0; i<list->count; i++) {
-        if (list->data[i].obj->id==id) return &list->data[i];
-    }
-    return NULL;
+/** Checks if an object is present in the render object list */
+renderobject *render_findrenderobject(renderer *r, gobject *obj) {
+    renderobject *robj = render_findrenderobjectwithid(r, obj->id);
+    return (robj && robj->obj==obj ? robj : NULL);
 }
 
 /** Adds an id to an id list only if it is not present already */
-renderobject *render_addobject(varray_renderobject *list, gobject *obj) {
-    renderobject *out = render_findrenderobject(list, obj);
+renderobject *render_addobject(renderer *r, gobject *obj) {
+    renderobject *out = render_findrenderobject(r, obj);
     if (!out) {
-        renderobject robj = { .obj = obj, .buffer = NULL, .voffset = 0, .eoffset = 0 };
-        if (varray_renderobjectadd(list, &robj, 1)) {
-            out = &list->data[list->count-1];
+        renderobject robj = { .obj = obj, .buffer = NULL, .voffset = 0, .eoffset = 0, .vhash = 0, .ehash = 0 };
+        if (varray_renderobjectadd(&r->objects, &robj, 1)) {
+            out = &r->objects.data[r->objects.count-1];
+            idmap_insert(&r->objectmap, (uint64_t) obj->id, r->objects.count-1);
         }
     }
     return out;
 }
 
 /** Finds the appropriate vertex buffer from  */
-renderglbuffers *render_findglbuffer(varray_renderglbuffers *list, char *format) {
-    for (unsigned int i=0; i<list->count; i++) {
-        if (strcmp(list->data[i].format, format)==0) return &list->data[i];
+renderglbuffers *render_findglbuffer(renderer *r, char *format) {
+    int i;
+    if (idmap_get(&r->buffermap, hash_bytes(format, strlen(format), 0), &i) &&
+        strcmp(r->glbuffers.data[i].format, format)==0) return &r->glbuffers.data[i];
+    
+    /* Formats whose hashes collide share an entry in the map */
+    for (unsigned int i=0; i<r->glbuffers.count; i++) {
+        if (strcmp(r->glbuffers.data[i].format, format)==0) return &r->glbuffers.data[i];
     }
     return NULL;
 }
 
 /** Adds an object to appropriate OpenGL buffers if it hasn't already been added. */
-void render_addobjecttoglbuffer(varray_renderglbuffers *list, renderobject *robj) {
+void render_addobjecttoglbuffer(renderer *r, renderobject *robj) {
     if (!robj || robj->buffer!=NULL) return; /* The renderobject already has been allocated to a buffer */
     
     /* First find if an appropriate OpenGL buffer exists for the given format */
-    renderglbuffers *buffer = render_findglbuffer(list, robj->obj->vertexdata.format);
+    char *format = robj->obj->vertexdata.format;
+    renderglbuffers *buffer = render_findglbuffer(r, format);
     if (!buffer) {
-        renderglbuffers new = { .format = robj->obj->vertexdata.format, .array = 0, .buffer = 0, .element = 0, .vlength = 0, .elength = 0};
-        if (varray_renderglbuffersadd(list, &new, 1)) {
-            buffer = &list->data[list->count-1];
+        renderglbuffers new = { .format = format, .array = 0, .buffer = 0, .element = 0, .vlength = 0, .elength = 0};
+        if (varray_renderglbuffersadd(&r->glbuffers, &new, 1)) {
+            buffer = &r->glbuffers.data[r->glbuffers.count-1];
+            idmap_insert(&r->buffermap, hash_bytes(format, strlen(format), 0), r->glbuffers.count-1);
         }
     }
     
@@ -456,21 +607,80 @@ void render_addobjecttoglbuffer(varray_renderglbuffers *list, renderobject *robj
 /** Calculate the size of vertex data given a format string */
 int render_entrysizefromformat(scene *s, char *format) {
     int size = 0;
-    for (char *c = format; *c != '\0'; c++) {
-        switch (*c) {
-            case 'x':
-            case 'n': size+=s->dim; break;
-            case 'c': size+=3; break;
-            default: break;
+    for (char *c = format; *c != '\0'; c++) size+=scene_attributesize(s, *c);
+    return size;
+}
+
+/** Hashes the vertex data of an object */
+static uint64_t render_hashvertices(scene *s, gobject *obj) {
+    float *data = scene_vertexdata(s, obj);
+    return (data ? hash_bytes(data, sizeof(float)*obj->vertexdata.length, 0) : 0);
+}
+
+/** Hashes the element data of an object */
+static uint64_t render_hashelements(scene *s, gobject *obj) {
+    uint64_t h = 0;
+    for (unsigned int i=0; i<obj->elements.count; i++) {
+        gelement *el=&obj->elements.data[i];
+        int *indices = scene_elementdata(s, el);
+        if (indices) h=hash_bytes(indices, sizeof(int)*el->length, h);
+    }
+    return h;
+}
+
+/** Copies an object's elements into the bound element array buffer */
+static void render_uploadelements(scene *s, renderobject *obj) {
+    int offset = obj->eoffset;
+    
+    for (unsigned int j=0; j<obj->obj->elements.count; j++) {
+        gelement *el=&obj->obj->elements.data[j];
+        int *indices = scene_elementdata(s, el);
+        
+        /* Copy the vertex indices over */
+        if (indices && el->length>0) {
+            glBufferSubData( GL_ELEMENT_ARRAY_BUFFER,
+                            sizeof(GLuint)*offset,
+                            sizeof(GLuint)*el->length,
+                            indices);
+        }
+        
+        offset+=el->length;
+    }
+}
+
+/** Describes the entries of the bound vertex buffer to the bound vertex array
+ *  @param[in] s - the scene
+ *  @param[in] format - format of the entries
+ *  @param[in] next - describe only the positions, as those of the next frame of a sequence */
+static void render_vertexattributes(scene *s, char *format, bool next) {
+    int entrysize = render_entrysizefromformat(s, format);
+    
+    unsigned int offset = 0;
+    for (unsigned int j=0; format[j]!='\0'; j++) {
+        if (format[j]=='x') {
+            GLuint location = (next ? 3 : 0);
+            glVertexAttribPointer(location, s->dim, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*entrysize, (void*) (sizeof(GLfloat)*offset));
+            glEnableVertexAttribArray(location);
+            offset += s->dim;
+        } else if (format[j]=='c') {
+            if (!next) {
+                glVertexAttribPointer(1, s->dim, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*entrysize, (void*) (sizeof(GLfloat)*offset));
+                glEnableVertexAttribArray(1);
+            }
+            offset += 3;
+        } else if (format[j]=='n') {
+            if (!next) {
+                glVertexAttribPointer(2, s->dim, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*entrysize, (void*) (sizeof(GLfloat)*offset));
+                glEnableVertexAttribArray(2);
+            }
+            offset += s->dim;
         }
     }
-    return size;
 }
 
 /** Draws an object to  newly allocated OpenGL buffers */
 void render_drawobject(renderer *r, scene *s, unsigned int i) {
     renderglbuffers *b = &r->glbuffers.data[i];
-    int entrysize = render_entrysizefromformat(s, b->format);
     
     glGenVertexArrays(1, &b->array);
     glGenBuffers(1, &b->buffer);
@@ -481,33 +691,20 @@ void render_drawobject(renderer *r, scene *s, unsigned int i) {
     glBindBuffer(GL_ARRAY_BUFFER, b->buffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*b->vlength, NULL, GL_STATIC_DRAW);
     
-    /* Copy all the object data into the buffer */
+    /* Copy all the object data into the buffer, straight from shared memory where it's held there */
     for (unsigned int j=0; j<r->objects.count; j++) {
         renderobject *obj = &r->objects.data[j];
-        if (obj && obj->buffer==b) {
+        float *data = scene_vertexdata(s, obj->obj);
+        if (obj && obj->buffer==b && data) {
             glBufferSubData( GL_ARRAY_BUFFER,
                             sizeof(GLfloat)*obj->voffset,
                             sizeof(GLfloat)*obj->obj->vertexdata.length,
-                            s->data.data+obj->obj->vertexdata.indx);
+                            data);
+            obj->vhash=render_hashvertices(s, obj->obj);
         }
     }
     
-    unsigned int offset = 0;
-    for (unsigned int j=0; b->format[j]!='\0'; j++) {
-        if (b->format[j]=='x') {
-            glVertexAttribPointer(0, s->dim, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*entrysize, (void*) (sizeof(GLfloat)*offset));
-            glEnableVertexAttribArray(0);
-            offset += s->dim;
-        } else if (b->format[j]=='c') {
-            glVertexAttribPointer(1, s->dim, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*entrysize, (void*) (sizeof(GLfloat)*offset));
-            glEnableVertexAttribArray(1);
-            offset += 3;
-        } else if (b->format[j]=='n') {
-            glVertexAttribPointer(2, s->dim, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*entrysize, (void*) (sizeof(GLfloat)*offset));
-            glEnableVertexAttribArray(2);
-            offset += s->dim;
-        }
-    }
+    render_vertexattributes(s, b->format, false);
     
     /* Unbind vertex array buffer */
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -517,35 +714,14 @@ void render_drawobject(renderer *r, scene *s, unsigned int i) {
     /* Size the element buffer */
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)*b->elength, NULL, GL_STATIC_DRAW);
     
-    /* Copy all the object element data into the buffer */
+    /* Copy all the object element data into the buffer unchanged; indices are offset to the object's vertices by
+       the base vertex of each draw */
     for (unsigned int j=0; j<r->objects.count; j++) {
         renderobject *obj = &r->objects.data[j];
         
         if (obj->buffer==b) {
-            int offset = obj->eoffset;
-            
-            /* Loop over elements */
-            for (unsigned int j=0; j<obj->obj->elements.count; j++) {
-                gelement *el=&obj->obj->elements.data[j];
-                
-                /* Offset the vertex indices by the vertex offset */
-                if (obj->voffset>0) for (unsigned int k=0; k<el->length; k++) {
-                    s->indx.data[el->indx+k] += obj->voffset/entrysize;
-                }
-                
-                /* Copy the vertex indices over */
-                glBufferSubData( GL_ELEMENT_ARRAY_BUFFER,
-                                sizeof(GLuint)*offset,
-                                sizeof(GLuint)*el->length,
-                                s->indx.data+el->indx);
-                
-                /* Restore vertex indices */
-                if (obj->voffset>0) for (unsigned int k=0; k<el->length; k++) {
-                    s->indx.data[el->indx+k] -= obj->voffset/entrysize;
-                }
-                
-                offset+=el->length;
-            }
+            render_uploadelements(s, obj);
+            obj->ehash=render_hashelements(s, obj->obj);
         }
     }
     
@@ -554,7 +730,7 @@ void render_drawobject(renderer *r, scene *s, unsigned int i) {
 
 /** Prepares an object for rendering, inserting appropriate instructions into the render list */
 void render_prepareobject(renderer *r, scene *s, gdraw *drw, GLuint *carray) {
-    renderobject *obj = render_findrenderobjectwithid(&r->objects, drw->id);
+    renderobject *obj = render_findrenderobjectwithid(r, drw->id);
     
     /* Select the vertex array if necessary */
     renderinstruction ins = { .instruction = RARRAY, .data.array.handle = obj->buffer->array, .obj=obj };
@@ -564,11 +740,15 @@ void render_prepareobject(renderer *r, scene *s, gdraw *drw, GLuint *carray) {
     /* Change the model matrix if provided */
     if (drw->matindx!=SCENE_EMPTY) {
         renderinstruction ins = { .instruction = RMODEL,
-                                  .data.model.model = &s->data.data[drw->matindx],
+                                  .data.model.indx = drw->matindx,
                                   .obj=obj };
         varray_renderinstructionadd(&r->renderlist, &ins, 1);
     }
     
+    /* Indices refer to the object's own vertices, which begin at its offset in the vertex buffer */
+    int entrysize = render_entrysizefromformat(s, obj->buffer->format);
+    int basevertex = (entrysize>0 ? obj->voffset/entrysize : 0);
+    
     /* Now loop over the elements in the object */
     int offset=obj->eoffset;
     for (unsigned int j=0; j<obj->obj->elements.count; j++) {
@@ -580,12 +760,14 @@ void render_prepareobject(renderer *r, scene *s, gdraw *drw, GLuint *carray) {
                 ins.instruction=RTRIANGLES;
                 ins.data.triangles.offset=(void *) (sizeof(GLuint)*offset);
                 ins.data.triangles.length=el->length;
+                ins.data.triangles.basevertex=basevertex;
                 offset+=el->length;
                 break;
             case LINES:
                 ins.instruction=RLINES;
                 ins.data.triangles.offset=(void *) (sizeof(GLuint)*offset);
                 ins.data.triangles.length=el->length;
+                ins.data.triangles.basevertex=basevertex;
                 offset+=el->length;
                 break;
             default:
@@ -600,11 +782,8 @@ void render_prepareobject(renderer *r, scene *s, gdraw *drw, GLuint *carray) {
  * Prepare scene
  * ------------------------------------------------------- */
 
-/** Prepares a scene for rendering */
-void render_preparescene(renderer *r, scene *s) {
-    render_preparefonts(r, s);
-    
-    /* Loop over the display list to identify objects */
+/** Assigns the objects in a scene's display list to vertex and element buffers, without allocating them */
+void render_layoutscene(renderer *r, scene *s) {
     for (unsigned int i=0; i<s->displaylist.count; i++) {
         gdraw *drw=&s->displaylist.data[i];
         switch (drw->type) {
@@ -614,23 +793,212 @@ void render_preparescene(renderer *r, scene *s) {
                 
                 /* Add the object to the scene if not already present */
                 gobject *obj = scene_getgobjectfromid(s, s->displaylist.data[i].id);
-                if (obj) robj=render_addobject(&r->objects, obj);
+                if (obj) robj=render_addobject(r, obj);
                 
                 /* Add vertex data to a suitable vertex buffer, or create one if necessary */
-                if (robj) render_addobjecttoglbuffer(&r->glbuffers, robj);
+                if (robj) render_addobjecttoglbuffer(r, robj);
             }
                 break;
             default:
                 break;
         }
     }
+}
+
+/* -------------------------------------------------------
+ * Compile the render list
+ * ------------------------------------------------------- */
+
+/** Orders draws by vertex array and model matrix, then by their place in the display list
+ *  @details Depth testing passes only fragments strictly nearer than those already drawn, so of two at the same
+ *  depth the first drawn is seen; keeping the display list order within each state, rather than ordering by the kind
+ *  of element, preserves which of lines and faces drawn over one another wins. An object's elements are laid out in
+ *  the order they're drawn, so contiguous ranges remain adjacent and can still be merged. */
+static int render_comparedraws(const void *a, const void *b) {
+    const renderdraw *x = a, *y = b;
+    if (x->array!=y->array) return (x->array<y->array ? -1 : 1);
+    if (x->model!=y->model) return (x->model<y->model ? -1 : 1);
+    return (x->order<y->order ? -1 : (x->order>y->order));
+}
+
+/** Checks whether two draws are made in the same state, so that they can be submitted together */
+static bool render_samestate(renderdraw *a, renderdraw *b) {
+    return (a->array==b->array &&
+            a->model==b->model &&
+            a->ins.instruction==b->ins.instruction);
+}
+
+/** Checks whether a draw continues another in the same state, so that the two can be made as one */
+static bool render_continuesdraw(renderdraw *a, renderdraw *b) {
+    return (render_samestate(a, b) &&
+            a->ins.data.triangles.basevertex==b->ins.data.triangles.basevertex &&
+            (char *) a->ins.data.triangles.offset+sizeof(GLuint)*a->ins.data.triangles.length==
+            (char *) b->ins.data.triangles.offset);
+}
+
+/** Primitive drawn by a draw instruction */
+static GLenum render_drawmode(renderinstruction *ins) {
+    switch (ins->instruction) {
+        case RLINES: return GL_LINES;
+        case RPOINTS: return GL_POINTS;
+        default: return GL_TRIANGLES;
+    }
+}
+
+/** @brief Compiles the render list into the lists drawn by each pass
+ *  @details Geometry draws are grouped by vertex array and model matrix, keeping the order of the display list within
+ *  each group, and adjacent element ranges are merged; each state change is then made once, and consecutive ranges
+ *  drawn in the same state are submitted together by a single RMULTIDRAW instruction. Text is blended, so
+ *  keeps the order of the display list, but state changes that leave the state unchanged are dropped. Each pass
+ *  starts with the identity model matrix, and text in white. */
+static void render_compilelists(renderer *r) {
+    varray_renderdraw draws;
+    varray_renderdrawinit(&draws);
+    
+    GLuint array=0;
+    renderobject *obj=NULL;
+    int model=-1, textmodel=-1;
+    float color[3] = { 1.0f, 1.0f, 1.0f }, textcolor[3] = { 1.0f, 1.0f, 1.0f };
+    
+    for (unsigned int i=0; i<r->renderlist.count; i++) {
+        renderinstruction *ins=&r->renderlist.data[i];
+        switch (ins->instruction) {
+            case RMODEL:
+                model=ins->data.model.indx;
+                break;
+            case RARRAY:
+                array=ins->data.array.handle;
+                obj=ins->obj;
+                break;
+            case RCOLOR:
+                memcpy(color, ins->data.color.rgb, sizeof(color));
+                break;
+            case RTRIANGLES: case RLINES: case RPOINTS:
+            {
+                renderdraw drw = { .ins = *ins, .array = array, .obj = obj, .model = model, .order = i };
+                varray_renderdrawwrite(&draws, drw);
+            }
+                break;
+            case RTEXT:
+                if (model!=textmodel) {
+                    renderinstruction set = { .instruction = RMODEL, .data.model.indx = model };
+                    varray_renderinstructionwrite(&r->text, set);
+                    textmodel=model;
+                }
+                if (memcmp(color, textcolor, sizeof(color))!=0) {
+                    renderinstruction set = { .instruction = RCOLOR };
+                    memcpy(set.data.color.rgb, color, sizeof(color));
+                    varray_renderinstructionwrite(&r->text, set);
+                    memcpy(textcolor, color, sizeof(color));
+                }
+                varray_renderinstructionwrite(&r->text, *ins);
+                break;
+            case RNOP: case RMULTIDRAW:
+                break;
+        }
+    }
     
-    /* Now allocate OpenGL buffers and arrays */
-    for (unsigned int i=0; i<r->glbuffers.count; i++) {
-        render_drawobject(r, s, i);
+    if (draws.count>1) qsort(draws.data, draws.count, sizeof(renderdraw), render_comparedraws);
+    
+    array=0;
+    model=-1;
+    for (unsigned int i=0; i<draws.count; i++) {
+        renderdraw *drw=&draws.data[i];
+        
+        if (drw->array!=array) {
+            renderinstruction set = { .instruction = RARRAY, .data.array.handle = drw->array, .obj = drw->obj };
+            varray_renderinstructionwrite(&r->geometry, set);
+            array=drw->array;
+        }
+        if (drw->model!=model) {
+            renderinstruction set = { .instruction = RMODEL, .data.model.indx = drw->model, .obj = drw->obj };
+            varray_renderinstructionwrite(&r->geometry, set);
+            model=drw->model;
+        }
+        
+        /* Collect the ranges drawn in this state, merging those that are contiguous */
+        renderinstruction ins = drw->ins;
+        int first = r->rangelengths.count, nranges = 0, length = 0;
+        for (;;) {
+            renderinstruction range = drw->ins;
+            while (i+1<draws.count && render_continuesdraw(drw, &draws.data[i+1])) {
+                range.data.triangles.length+=draws.data[i+1].ins.data.triangles.length;
+                drw=&draws.data[++i];
+            }
+            
+            if (nranges==0) ins=range;
+            varray_intwrite(&r->rangelengths, range.data.triangles.length);
+            varray_renderoffsetwrite(&r->rangeoffsets, range.data.triangles.offset);
+            varray_intwrite(&r->rangebasevertices, range.data.triangles.basevertex);
+            nranges++;
+            length+=range.data.triangles.length;
+            
+            if (i+1>=draws.count || !render_samestate(drw, &draws.data[i+1])) break;
+            drw=&draws.data[++i];
+        }
+        
+        if (nranges>1) {
+            renderinstruction multi = { .instruction = RMULTIDRAW,
+                                        .data.multidraw.mode = render_drawmode(&ins),
+                                        .data.multidraw.first = first,
+                                        .data.multidraw.count = nranges,
+                                        .data.multidraw.length = length,
+                                        .obj = ins.obj };
+            varray_renderinstructionwrite(&r->geometry, multi);
+        } else {
+            /* A single range is drawn as it is */
+            r->rangelengths.count=first;
+            r->rangeoffsets.count=first;
+            r->rangebasevertices.count=first;
+            varray_renderinstructionwrite(&r->geometry, ins);
+        }
     }
     
-    /* Now create the object render list */
+    varray_renderdrawclear(&draws);
+}
+
+/** Counts the calls made to draw a compiled scene
+ *  @param[in] r - renderer that has compiled the scene
+ *  @param[out] before - calls made by drawing the render list in display list order, as each pass once did
+ *  @param[out] after - calls made by drawing the compiled lists */
+void render_liststats(renderer *r, renderstats *before, renderstats *after) {
+    *before = (renderstats) { .draws = 0 };
+    *after = (renderstats) { .draws = 0 };
+    
+    /* Both passes walked the whole list, and selected every model matrix */
+    for (unsigned int i=0; i<r->renderlist.count; i++) {
+        switch (r->renderlist.data[i].instruction) {
+            case RMODEL: before->models+=2; break;
+            case RARRAY: before->arrays++; break;
+            case RCOLOR: before->colors++; break;
+            case RTRIANGLES: case RLINES: case RPOINTS: case RTEXT: case RMULTIDRAW: before->draws++; break;
+            case RNOP: break;
+        }
+    }
+    
+    varray_renderinstruction *lists[2] = { &r->geometry, &r->text };
+    for (int k=0; k<2; k++) {
+        for (unsigned int i=0; i<lists[k]->count; i++) {
+            switch (lists[k]->data[i].instruction) {
+                case RMODEL: after->models++; break;
+                case RARRAY: after->arrays++; break;
+                case RCOLOR: after->colors++; break;
+                case RTRIANGLES: case RLINES: case RPOINTS: case RTEXT: case RMULTIDRAW: after->draws++; break;
+                case RNOP: break;
+            }
+        }
+    }
+}
+
+/** Creates the render list for a scene once its buffers have been allocated, and compiles it into the lists drawn */
+void render_compilescene(renderer *r, scene *s) {
+    r->renderlist.count=0;
+    r->geometry.count=0;
+    r->text.count=0;
+    r->rangelengths.count=0;
+    r->rangeoffsets.count=0;
+    r->rangebasevertices.count=0;
+    
     GLuint carray=0;
     for (unsigned int i=0; i<s->displaylist.count; i++) {
         gdraw *drw=&s->displaylist.data[i];
@@ -647,7 +1015,7 @@ void render_preparescene(renderer *r, scene *s) {
                 
                 if (color) {
                     renderinstruction ins = { .instruction = RCOLOR };
-                    for (int i=0; i<3; i++) ins.data.color.rgb[i]=s->data.data[color->indx+i];
+                    for (int i=0; i<3; i++) ins.data.color.rgb[i]=s->colors.data[color->indx+i];
                 
                     varray_renderinstructionadd(&r->renderlist, &ins, 1);
                 } else {
@@ -657,108 +1025,464 @@ void render_preparescene(renderer *r, scene *s) {
                 break;
         }
     }
+    
+    render_compilelists(r);
+    
+    r->matrices=&s->matrices;
+    r->ndraws=s->displaylist.count;
+    r->uniformsvalid=false;
+}
+
+/** Prepares a scene for rendering */
+void render_preparescene(renderer *r, scene *s) {
+    render_preparefonts(r, s);
+    
+    /* Identify objects to be drawn and lay out the buffers that will hold them */
+    render_layoutscene(r, s);
+    
+    /* Now allocate OpenGL buffers and arrays */
+    for (unsigned int i=0; i<r->glbuffers.count; i++) {
+        render_drawobject(r, s, i);
+    }
+    
+    /* Now create the object render list */
+    render_compilescene(r, s);
+    r->ntexts=s->textlist.count;
+}
+
+/** Checks whether two renderers lay out their objects identically, so that one's buffers can hold the other's data */
+static bool render_layoutmatches(renderer *r, renderer *layout) {
+    if (r->glbuffers.count!=layout->glbuffers.count ||
+        r->objects.count!=layout->objects.count) return false;
+    
+    for (unsigned int i=0; i<r->glbuffers.count; i++) {
+        renderglbuffers *a=&r->glbuffers.data[i], *b=&layout->glbuffers.data[i];
+        if (strcmp(a->format, b->format)!=0 ||
+            a->vlength!=b->vlength ||
+            a->elength!=b->elength) return false;
+    }
+    
+    for (unsigned int i=0; i<r->objects.count; i++) {
+        renderobject *a=&r->objects.data[i], *b=&layout->objects.data[i];
+        if (a->obj->id!=b->obj->id ||
+            a->buffer-r->glbuffers.data!=b->buffer-layout->glbuffers.data ||
+            a->voffset!=b->voffset ||
+            a->eoffset!=b->eoffset) return false;
+    }
+    
+    return true;
+}
+
+/** Lays out a scene without allocating any buffers and, if it matches the current layout, points the renderer's
+ *  objects and buffers at the scene's
+ *  @returns true if the layout matches; otherwise the renderer is unchanged */
+static bool render_adoptlayout(renderer *r, scene *s) {
+    renderer layout;
+    render_initlayout(&layout);
+    render_layoutscene(&layout, s);
+    
+    bool match=render_layoutmatches(r, &layout);
+    
+    /* Buffer formats are held by the objects, so they too now refer to the scene's */
+    for (unsigned int i=0; match && i<r->objects.count; i++) {
+        r->objects.data[i].obj=layout.objects.data[i].obj;
+    }
+    for (unsigned int i=0; match && i<r->glbuffers.count; i++) {
+        r->glbuffers.data[i].format=layout.glbuffers.data[i].format;
+    }
+    
+    render_clearlayout(&layout);
+    return match;
+}
+
+/** Checks whether two scenes use the same fonts, so that their textures can be kept */
+static bool render_fontsmatch(scene *old, scene *new) {
+    if (old->fontlist.count!=new->fontlist.count) return false;
+    
+    for (unsigned int i=0; i<old->fontlist.count; i++) {
+        gfont *a=&old->fontlist.data[i], *b=&new->fontlist.data[i];
+        if (a->id!=b->id || a->size!=b->size || strcmp(a->file, b->file)!=0) return false;
+    }
+    return true;
+}
+
+/** @brief Updates a prepared scene in place to show a new version of it
+ *  @details Objects are matched by id. If the new scene lays out its objects in the same buffers at the same offsets,
+ *  only the vertex and element data whose content hash has changed is uploaded again, and the render list is rebuilt;
+ *  the renderer then refers to the new scene, which the caller should keep in place of the old one.
+ *  @param[in] r - renderer that has prepared the old scene
+ *  @param[in] old - the scene currently shown
+ *  @param[in] new - the new version of the scene
+ *  @returns true on success, or false if the layout differs, in which case the renderer is unchanged and the new
+ *  scene must be prepared afresh */
+bool render_updatescene(renderer *r, scene *old, scene *new) {
+    if (old->dim!=new->dim || !render_fontsmatch(old, new) || !render_adoptlayout(r, new)) return false;
+    
+    for (unsigned int i=0; i<r->objects.count; i++) {
+        renderobject *robj=&r->objects.data[i];
+        float *data = scene_vertexdata(new, robj->obj);
+        uint64_t vhash = render_hashvertices(new, robj->obj);
+        if (data && vhash!=robj->vhash) {
+            glBindBuffer(GL_ARRAY_BUFFER, robj->buffer->buffer);
+            glBufferSubData(GL_ARRAY_BUFFER,
+                            sizeof(GLfloat)*robj->voffset,
+                            sizeof(GLfloat)*robj->obj->vertexdata.length,
+                            data);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            robj->vhash=vhash;
+        }
+        
+        uint64_t ehash = render_hashelements(new, robj->obj);
+        if (ehash!=robj->ehash) {
+            /* The element array buffer is part of the state of the vertex array */
+            glBindVertexArray(robj->buffer->array);
+            render_uploadelements(new, robj);
+            glBindVertexArray(0);
+            robj->ehash=ehash;
+        }
+    }
+    
+    /* The font textures are unchanged, but glyphs are looked up in the new scene's fonts */
+    idmap_empty(&r->fontmap);
+    for (unsigned int i=0; i<r->fonts.count; i++) {
+        textfont *font=&new->fontlist.data[i].font;
+        text_generatetexture(font);
+        r->fonts.data[i].font=font;
+        idmap_insert(&r->fontmap, (uint64_t) (uintptr_t) font, i);
+    }
+    
+    render_compilescene(r, new);
+    
+    return true;
+}
+
+/** @brief Applies changes made in place to a prepared scene, e.g. by update commands
+ *  @details Vertex data changed in place is uploaded again into the object's existing place in its vertex buffer. The
+ *  render list is compiled again only if entries in the display list have changed; otherwise it is kept, and picks
+ *  up model matrices changed in place as it refers to them by their index in the scene's matrix array.
+ *  @param[in] r - renderer that has prepared the scene
+ *  @param[in] s - the scene
+ *  @returns true on success, or false if objects, fonts or text have been added, removed or resized, in which case
+ *  the scene must be prepared afresh */
+bool render_applyedits(renderer *r, scene *s) {
+    if (!r->fontvao ||
+        r->fonts.count!=s->fontlist.count ||
+        r->ntexts!=s->textlist.count ||
+        !render_adoptlayout(r, s)) return false;
+    
+    for (unsigned int i=0; i<r->objects.count; i++) {
+        renderobject *robj=&r->objects.data[i];
+        gobject *obj=robj->obj;
+        int start=obj->vertexdata.dirtystart, end=obj->vertexdata.dirtyend;
+        float *data = scene_vertexdata(s, obj);
+        
+        if (data && start<end) {
+            glBindBuffer(GL_ARRAY_BUFFER, robj->buffer->buffer);
+            glBufferSubData(GL_ARRAY_BUFFER,
+                            sizeof(GLfloat)*(robj->voffset+start),
+                            sizeof(GLfloat)*(end-start),
+                            data+start);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            robj->vhash=0; /* No longer known, so that the object is uploaded again by render_updatescene */
+        }
+    }
+    
+    if (s->listedited || r->ndraws!=s->displaylist.count) {
+        render_compilescene(r, s);
+    } else {
+        r->matrices=&s->matrices;
+        r->uniformsvalid=false; /* Matrices may have been changed in place */
+    }
+    
+    return true;
+}
+
+/** Allocates the vertex buffers and arrays of the frame ring for a buffer. Each array draws the positions held in the
+ *  next slot as those of the next frame, and shares the element array buffer, so elements are never uploaded again. */
+static void render_prepareframering(scene *s, renderglbuffers *b) {
+    glGenVertexArrays(RENDER_FRAMERING, b->framearray);
+    glGenBuffers(RENDER_FRAMERING, b->framebuffer);
+    
+    for (int i=0; i<RENDER_FRAMERING; i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, b->framebuffer[i]);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*b->vlength, NULL, GL_STREAM_DRAW);
+    }
+    
+    for (int i=0; i<RENDER_FRAMERING; i++) {
+        glBindVertexArray(b->framearray[i]);
+        
+        glBindBuffer(GL_ARRAY_BUFFER, b->framebuffer[i]);
+        render_vertexattributes(s, b->format, false);
+        glBindBuffer(GL_ARRAY_BUFFER, b->framebuffer[(i+1)%RENDER_FRAMERING]);
+        render_vertexattributes(s, b->format, true);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, b->element);
+        glBindVertexArray(0);
+    }
+}
+
+/** @brief Uploads the vertex data of a frame of a sequence into a slot of the frame ring
+ *  @details Frames must lay out as the scene prepared; only their vertex data is used. The frame is drawn by setting
+ *  the renderer's frame to the slot. The ring is allocated when first used.
+ *  @param[in] r - renderer that has prepared the first frame
+ *  @param[in] slot - slot in the frame ring
+ *  @param[in] frame - the frame
+ *  @returns true on success, or false if the frame's layout differs */
+bool render_uploadframe(renderer *r, int slot, scene *frame) {
+    if (slot<0 || slot>=RENDER_FRAMERING) return false;
+    
+    renderer layout;
+    render_initlayout(&layout);
+    render_layoutscene(&layout, frame);
+    
+    bool match=render_layoutmatches(r, &layout);
+    
+    for (unsigned int i=0; match && i<r->glbuffers.count; i++) {
+        renderglbuffers *b=&r->glbuffers.data[i];
+        if (!b->framearray[0]) render_prepareframering(frame, b);
+    }
+    
+    for (unsigned int i=0; match && i<r->objects.count; i++) {
+        renderobject *robj=&r->objects.data[i];
+        gobject *obj=layout.objects.data[i].obj;
+        float *data=scene_vertexdata(frame, obj);
+        
+        if (data) {
+            glBindBuffer(GL_ARRAY_BUFFER, robj->buffer->framebuffer[slot]);
+            glBufferSubData(GL_ARRAY_BUFFER,
+                            sizeof(GLfloat)*robj->voffset,
+                            sizeof(GLfloat)*obj->vertexdata.length,
+                            data);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+    
+    render_clearlayout(&layout);
+    return match;
 }
 
 /* -------------------------------------------------------
  * Render the scene
  * ------------------------------------------------------- */
 
+/** Whether the GPU time taken to draw objects is measured */
+static bool renderprofiling = false;
+
+/** Sets whether renderers measure and report the GPU time taken to draw objects */
+void render_setprofile(bool profile) {
+    renderprofiling=profile;
+}
+
+/** Computes the transforms for a model matrix with a given view */
+static void render_computeuniforms(mat4x4 view, mat4x4 model, renderuniforms *out) {
+    mat3x3 normal;
+    mat3d_mul4x4(view, model, out->modelview);
+    mat3d_normalmatrix(out->modelview, normal);
+    
+    for (int i=0; i<3; i++) {
+        for (int j=0; j<3; j++) out->normal[4*i+j]=normal[3*i+j];
+        out->normal[4*i+3]=0.0f;
+    }
+}
+
+/** Uploads the transforms into their uniform buffer, each block at its aligned offset */
+static void render_uploaduniforms(renderer *r) {
+    unsigned int n = r->uniforms.count;
+    unsigned int nblocks = (n+RENDER_DRAWBLOCK-1)/RENDER_DRAWBLOCK;
+    GLsizeiptr size = nblocks*r->drawstride;
+    
+    glBindBuffer(GL_UNIFORM_BUFFER, r->drawubo);
+    if (size>r->drawubosize) {
+        /* Blocks are bound whole, so the buffer always holds a whole number of them */
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+        r->drawubosize=size;
+    }
+    
+    for (unsigned int b=0; b<nblocks; b++) {
+        unsigned int start = b*RENDER_DRAWBLOCK;
+        unsigned int count = (n-start<RENDER_DRAWBLOCK ? n-start : RENDER_DRAWBLOCK);
+        glBufferSubData(GL_UNIFORM_BUFFER, b*r->drawstride, count*sizeof(renderuniforms), r->uniforms.data+start);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/** Computes and uploads the transforms for the identity and each of the scene's model matrices, unless they are up
+ *  to date with the view */
+static void render_updateuniforms(renderer *r, mat4x4 view) {
+    unsigned int n = (r->matrices ? r->matrices->count : 0);
+    if (r->uniformsvalid &&
+        r->uniforms.count==n+1 &&
+        memcmp(r->uniformview, view, sizeof(mat4x4))==0) return;
+    
+    mat4x4 identity;
+    mat3d_identity4x4(identity);
+    
+    r->uniforms.count=0;
+    for (unsigned int i=0; i<=n; i++) {
+        renderuniforms u;
+        render_computeuniforms(view, (i==0 ? identity : r->matrices->data[i-1].m), &u);
+        varray_renderuniformswrite(&r->uniforms, u);
+    }
+    render_uploaduniforms(r);
+    
+    memcpy(r->uniformview, view, sizeof(mat4x4));
+    r->uniformsvalid=true;
+}
+
+/** Selects the transforms used by the current program, binding the block of the buffer that holds them if needed
+ *  @param[in] r - the renderer
+ *  @param[in] i - index of the transforms, where 0 is the identity model matrix and i the scene's matrix i-1
+ *  @param[in] indexuniform - location of the program's drawindex uniform
+ *  @param[in,out] block - block of transforms bound, or -1 if none */
+static void render_selectuniforms(renderer *r, int i, GLint indexuniform, int *block) {
+    int b = i/RENDER_DRAWBLOCK;
+    if (b!=*block) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, RENDER_DRAWBINDING, r->drawubo,
+                          b*r->drawstride, RENDER_DRAWBLOCK*sizeof(renderuniforms));
+        *block=b;
+    }
+    glUniform1i(indexuniform, i%RENDER_DRAWBLOCK);
+}
+
+/** Collects the result of the last frame's timer query, reporting once enough frames have been timed, and starts
+ *  timing this frame
+ *  @returns true if a query was started */
+static bool render_begintimer(renderer *r) {
+    renderprofile *p = &r->profile;
+    if (!p->query) glGenQueries(1, &p->query);
+    
+    if (p->pending) {
+        /* Results arrive frames later; frames drawn meanwhile aren't timed, so as not to stall the pipeline */
+        GLuint available=0;
+        glGetQueryObjectuiv(p->query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+        
+        GLuint64 ns=0;
+        glGetQueryObjectui64v(p->query, GL_QUERY_RESULT, &ns);
+        p->pending=false;
+        p->seconds+=ns*1e-9;
+        p->total+=p->vertices;
+        p->frames++;
+    }
+    
+    if (p->frames>=RENDER_PROFILEINTERVAL) {
+        fprintf(stderr, "morphoview: %.3f ms per frame drawing objects, %.1f million vertices per second.\n",
+                1e3*p->seconds/p->frames, (p->seconds>0 ? 1e-6*p->total/p->seconds : 0.0));
+        p->frames=0;
+        p->seconds=0;
+        p->total=0;
+    }
+    
+    glBeginQuery(GL_TIME_ELAPSED, p->query);
+    return true;
+}
+
 void render_render(renderer *r, float aspectratio, mat4x4 view) {
     /* Clear the display */
     glClearColor(0.160784f, 0.164706f, 0.188235f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
-    /* Load the shader */
-    glUseProgram(r->shader);
+    /* The view, projection and lighting are uploaded once into the Frame block, which both programs share */
+    renderframe frame = {
+        .lightcolor = {1.0f, 1.0f, 1.0f},
+        .lightpos = {2.0f, 1.0f, 5.0f},
+        .viewpos = {0.0f, 0.0f, 1.0f}
+    };
+    memcpy(frame.view, view, sizeof(mat4x4));
+    mat3d_ortho(NULL, frame.proj, -1.0*aspectratio, 1.0*aspectratio, -1.0, 1.0, 1.0, 10.0);
     
-    /* Location of shader properties */
-    GLint modeluniform = glGetUniformLocation(r->shader, "model");
-    GLint viewuniform = glGetUniformLocation(r->shader, "view");
-    GLint projuniform = glGetUniformLocation(r->shader, "proj");
+    glBindBuffer(GL_UNIFORM_BUFFER, r->frameubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(renderframe), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, RENDER_FRAMEBINDING, r->frameubo);
     
-    GLint lightcoloruniform = glGetUniformLocation(r->shader, "lightColor");
-    GLint lightposuniform = glGetUniformLocation(r->shader, "lightPos");
-    GLint viewposuniform = glGetUniformLocation(r->shader, "viewPos");
+    /* The model-view and normal matrices are computed once for each model matrix, and kept while the view is unchanged */
+    render_updateuniforms(r, view);
     
-    /* Set up the lighting */
-    vec3 lightcolor = {1.0f, 1.0f, 1.0f};
-    vec3 lightposn = {2.0f, 1.0f, 5.0f};
-    vec3 viewposn = {0.0f, 0.0f, 1.0f};
+    /* Load the shader */
+    glUseProgram(r->shader);
     
-    glUniform3fv(lightcoloruniform, 1, lightcolor);
-    glUniform3fv(lightposuniform, 1, lightposn);
-    glUniform3fv(viewposuniform, 1, viewposn);
+    /* Positions are interpolated towards the next frame only during playback */
+    glUniform1f(r->blenduniform, (r->frame>=0 ? r->blend : 0.0f));
     
-    /* Set up the view matrix */
-    glUniformMatrix4fv(viewuniform, 1, GL_FALSE, view);
+    int block=-1;
+    render_selectuniforms(r, 0, r->drawuniform, &block);
     
-    /* Set up the projection matrix */
-    mat4x4 proj;
-    mat3d_ortho(NULL, proj, -1.0*aspectratio, 1.0*aspectratio, -1.0, 1.0, 1.0, 10.0);
-    glUniformMatrix4fv(projuniform, 1, GL_FALSE, proj);
+    bool timed = (renderprofiling && render_begintimer(r));
+    int64_t vertices = 0;
     
     /* Render objects */
-    for (unsigned i=0; i<r->renderlist.count; i++) {
-        renderinstruction *ins=&r->renderlist.data[i];
+    for (unsigned i=0; i<r->geometry.count; i++) {
+        renderinstruction *ins=&r->geometry.data[i];
         switch (ins->instruction) {
             case RNOP: break;
             case RMODEL:
-                glUniformMatrix4fv(modeluniform, 1, GL_FALSE, ins->data.model.model);
+                render_selectuniforms(r, ins->data.model.indx+1, r->drawuniform, &block);
                 break;
             case RARRAY:
-                glBindVertexArray(ins->data.array.handle);
+                if (r->frame>=0 && ins->obj) glBindVertexArray(ins->obj->buffer->framearray[r->frame]);
+                else glBindVertexArray(ins->data.array.handle);
                 break;
             case RTRIANGLES:
-                glDrawElements(GL_TRIANGLES, ins->data.triangles.length, GL_UNSIGNED_INT, ins->data.triangles.offset);
+                glDrawElementsBaseVertex(GL_TRIANGLES, ins->data.triangles.length, GL_UNSIGNED_INT, ins->data.triangles.offset, ins->data.triangles.basevertex);
+                vertices+=ins->data.triangles.length;
                 break;
             case RLINES:
-                glDrawElements(GL_LINES, ins->data.triangles.length, GL_UNSIGNED_INT, ins->data.triangles.offset);
+                glDrawElementsBaseVertex(GL_LINES, ins->data.triangles.length, GL_UNSIGNED_INT, ins->data.triangles.offset, ins->data.triangles.basevertex);
+                vertices+=ins->data.triangles.length;
                 break;
             case RPOINTS:
-                glDrawElements(GL_POINTS, ins->data.triangles.length, GL_UNSIGNED_INT, ins->data.triangles.offset);
+                glDrawElementsBaseVertex(GL_POINTS, ins->data.triangles.length, GL_UNSIGNED_INT, ins->data.triangles.offset, ins->data.triangles.basevertex);
+                vertices+=ins->data.triangles.length;
+                break;
+            case RMULTIDRAW:
+                glMultiDrawElementsBaseVertex(ins->data.multidraw.mode,
+                                              r->rangelengths.data+ins->data.multidraw.first,
+                                              GL_UNSIGNED_INT,
+                                              (const void * const *) (r->rangeoffsets.data+ins->data.multidraw.first),
+                                              ins->data.multidraw.count,
+                                              r->rangebasevertices.data+ins->data.multidraw.first);
+                vertices+=ins->data.multidraw.length;
                 break;
             case RTEXT: case RCOLOR:
                 break;
         }
     }
     
+    if (timed) {
+        glEndQuery(GL_TIME_ELAPSED);
+        r->profile.pending=true;
+        r->profile.vertices=vertices;
+    }
+    
     /* Now text rendering pass */
     glUseProgram(r->textshader);
     
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
-    GLint textcoloruniform = glGetUniformLocation(r->textshader, "textColor");
     vec3 textcolor = {1.0f, 1.0f, 1.0f};
-    glUniform3fv(textcoloruniform, 1, textcolor);
+    glUniform3fv(r->textcoloruniform, 1, textcolor);
     
-    modeluniform = glGetUniformLocation(r->textshader, "model");
-    viewuniform = glGetUniformLocation(r->textshader, "view");
-    projuniform = glGetUniformLocation(r->textshader, "proj");
-    
-    glUniformMatrix4fv(viewuniform, 1, GL_FALSE, view);
-    glUniformMatrix4fv(projuniform, 1, GL_FALSE, proj);
-    
-    mat4x4 model;
-    mat3d_identity4x4(model);
-    glUniformMatrix4fv(modeluniform, 1, GL_FALSE, model);
+    render_selectuniforms(r, 0, r->textdrawuniform, &block);
     
     glActiveTexture(GL_TEXTURE0);
     glBindVertexArray(r->fontvao);
     
     /* Render objects */
-    for (unsigned i=0; i<r->renderlist.count; i++) {
-        renderinstruction *ins=&r->renderlist.data[i];
+    for (unsigned i=0; i<r->text.count; i++) {
+        renderinstruction *ins=&r->text.data[i];
         switch (ins->instruction) {
             case RMODEL:
-                glUniformMatrix4fv(modeluniform, 1, GL_FALSE, ins->data.model.model);
+                render_selectuniforms(r, ins->data.model.indx+1, r->textdrawuniform, &block);
                 break;
             case RTEXT:
                 render_rendertext(r, ins->data.text.rfontid, ins->data.text.txt);
                 //render_renderfonttextureatlas(r, ins->data.text.rfontid);
                 break;
             case RCOLOR:
-                glUniform3fv(textcoloruniform, 1, ins->data.color.rgb);
+                glUniform3fv(r->textcoloruniform, 1, ins->data.color.rgb);
                 break;
             default:
                 break;
@@ -766,6 +1490,8 @@ void render_render(renderer *r, float aspectratio, mat4x4 view) {
     }
     /* End text rendering */
     
+    glDisable(GL_BLEND);
+    
     GLenum er = glGetError();
     if (er!=0) {
         fprintf(stderr, "OpenGL error %u\n",er);
@@ -10,14 +10,31 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "varray.h"
 #include "matrix3d.h"
 #include "scene.h"
+#include "idmap.h"
 
 #define GL_SILENCE_DEPRECATION
 #include <glad/glad.h>
 
 DECLARE_VARRAY(GLuint, GLuint)
+DECLARE_VARRAY(renderoffset, void *)
+
+/** Number of frames of a sequence whose vertex data is held on the GPU at once during playback */
+#define RENDER_FRAMERING 4
+
+/** Number of frames timed between each report when profiling */
+#define RENDER_PROFILEINTERVAL 100
+
+/** Binding points of the uniform blocks shared by the shader programs */
+#define RENDER_FRAMEBINDING 0
+#define RENDER_DRAWBINDING 1
+
+/** Number of transforms in the shaders' Draws uniform block; scenes with more are drawn by binding successive
+ *  blocks of the buffer that holds them. Kept within the 16KB a uniform block is guaranteed. */
+#define RENDER_DRAWBLOCK 128
 
 /** @brief Structure to hold information about OpenGL buffers.
  *  @details Each of these includes several types of OpenGL buffer:
@@ -32,6 +49,8 @@ typedef struct {
     GLuint element; /* Handle for element array buffer object */
     int vlength; /* Length of the vertex buffer */
     int elength; /* Length of the element array buffer */
+    GLuint framearray[RENDER_FRAMERING]; /* Vertex arrays for the frame ring, sharing the element array buffer */
+    GLuint framebuffer[RENDER_FRAMERING]; /* Vertex buffers for the frame ring */
 } renderglbuffers;
 
 DECLARE_VARRAY(renderglbuffers, renderglbuffers)
@@ -43,6 +62,8 @@ typedef struct {
     renderglbuffers *buffer; /* Pointer to OpenGL buffer collection */
     int voffset; /* Offset into the vertex buffer */
     int eoffset; /* Offset into the element array buffer */
+    uint64_t vhash; /* Hash of the vertex data uploaded, so that unchanged data needn't be uploaded again */
+    uint64_t ehash; /* Hash of the element data uploaded */
 } renderobject;
 
 DECLARE_VARRAY(renderobject, renderobject)
@@ -66,11 +87,12 @@ typedef struct {
         RPOINTS, /* Draw points */
         RTEXT, /* Draw text */
         RCOLOR, /* Set the current color */
+        RMULTIDRAW, /* Draw several ranges of the element array buffer at once */
     } instruction;
     
     union {
         struct {
-            float *model;
+            int indx; /* Index of the matrix in the scene's matrix array */
         } model;
         
         struct {
@@ -80,6 +102,7 @@ typedef struct {
         struct {
             int length;
             void *offset;
+            int basevertex; /* Added to each index, locating the object's vertices in the buffer */
         } triangles;
         
         struct {
@@ -90,6 +113,13 @@ typedef struct {
         struct {
             float rgb[3]; 
         } color;
+        
+        struct {
+            GLenum mode; /* Primitive drawn */
+            int first; /* Index of the first range in the renderer's range arrays */
+            int count; /* Number of ranges */
+            int length; /* Total number of indices drawn */
+        } multidraw;
     } data;
     
     renderobject *obj;
@@ -97,6 +127,42 @@ typedef struct {
 
 DECLARE_VARRAY(renderinstruction, renderinstruction)
 
+/** @brief Counts of the calls made to draw a scene each frame */
+typedef struct {
+    int draws; /* Draw calls, counting each text once */
+    int arrays; /* Vertex arrays bound */
+    int models; /* Model matrices selected */
+    int colors; /* Text colors set */
+} renderstats;
+
+/** @brief State shared by every draw in a frame, laid out as the shaders' Frame uniform block (std140) */
+typedef struct {
+    mat4x4 view;
+    mat4x4 proj;
+    float lightcolor[4]; /* Vectors are padded to four floats */
+    float lightpos[4];
+    float viewpos[4];
+} renderframe;
+
+/** @brief Transforms applied by the shader for a model matrix, computed from it and the view on the CPU, and laid
+ *  out as an entry of the shaders' Draws uniform block (std140) */
+typedef struct {
+    mat4x4 modelview; /* Product of the view and model matrices */
+    float normal[12]; /* Inverse transpose of the model-view matrix, which transforms normals; columns are padded */
+} renderuniforms;
+
+DECLARE_VARRAY(renderuniforms, renderuniforms)
+
+/** @brief Times the GPU spends drawing objects, for profiling */
+typedef struct {
+    GLuint query; /* Timer query, or 0 if none has been created */
+    bool pending; /* Whether the query is waiting for its result */
+    int64_t vertices; /* Vertices drawn while the pending query ran */
+    int frames; /* Frames timed since the last report */
+    double seconds; /* GPU time taken by them */
+    double total; /* Vertices drawn by them */
+} renderprofile;
+
 /** Renderer object. */
 typedef struct {
     GLuint shader;
@@ -104,15 +170,53 @@ typedef struct {
     varray_renderobject objects;
     varray_renderfont fonts;
     varray_renderglbuffers glbuffers;
-    varray_renderinstruction renderlist;
+    varray_renderinstruction renderlist; /* Instructions in display list order, from which the lists drawn are compiled */
+    varray_renderinstruction geometry; /* Instructions drawn by the geometry pass, sorted by state */
+    varray_renderinstruction text; /* Instructions drawn by the text pass */
+    varray_int rangelengths; /* Number of indices in each range drawn by RMULTIDRAW instructions */
+    varray_renderoffset rangeoffsets; /* Offset of each range in the element array buffer */
+    varray_int rangebasevertices; /* Base vertex of each range */
     GLuint fontvao;
     GLuint fontvbo;
+    varray_gmatrix *matrices; /* Model matrices of the scene the render list was compiled from */
+    int ndraws; /* Length of the display list the render list was compiled from */
+    int ntexts; /* Number of texts prepared */
+    int frame; /* Slot of the frame ring to draw, or -1 to draw the scene's own vertex data */
+    float blend; /* Fraction of the way from the frame drawn to the one in the next slot */
+    idmap objectmap; /* Position of each render object by object id */
+    idmap buffermap; /* Position of each buffer by a hash of its format */
+    idmap fontmap; /* Position of each font by the address of its textfont */
+    varray_renderuniforms uniforms; /* Transforms with the current view: the first for the identity model matrix, used
+                                       until one is set, then one for each of the scene's model matrices */
+    mat4x4 uniformview; /* View matrix the transforms were computed with */
+    bool uniformsvalid; /* Whether the transforms are up to date with the scene's matrices */
+    GLuint frameubo; /* Uniform buffer holding the Frame block */
+    GLuint drawubo; /* Uniform buffer holding the transforms, in blocks of RENDER_DRAWBLOCK */
+    GLsizeiptr drawubosize; /* Bytes allocated for the transforms */
+    GLsizeiptr drawstride; /* Offset between blocks of transforms, a multiple of the alignment the GPU requires */
+    GLint blenduniform; /* Locations of the uniforms set outside the blocks */
+    GLint drawuniform;
+    GLint textcoloruniform;
+    GLint textdrawuniform;
+    renderprofile profile;
 } renderer;
 
 bool render_init(renderer *r);
 void render_clear(renderer *r);
+void render_reset(renderer *r);
+void render_initlayout(renderer *r);
+void render_clearlayout(renderer *r);
 
+int render_entrysizefromformat(scene *s, char *format);
+void render_layoutscene(renderer *r, scene *s);
+void render_compilescene(renderer *r, scene *s);
 void render_preparescene(renderer *r, scene *s);
+bool render_updatescene(renderer *r, scene *old, scene *new);
+bool render_applyedits(renderer *r, scene *s);
+void render_liststats(renderer *r, renderstats *before, renderstats *after);
+bool render_uploadframe(renderer *r, int slot, scene *frame);
 void render_render(renderer *r, float aspectratio, mat4x4 view);
 
+void render_setprofile(bool profile);
+
 #endif /* render_h */
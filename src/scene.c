@@ -5,7 +5,9 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "scene.h"
+#include "matrix3d.h"
 
 /* -------------------------------------------------------
  * Constructor/Destructor
@@ -24,26 +26,26 @@ scene *scene_new(int id, int dim) {
         varray_gtextinit(&new->textlist);
         varray_floatinit(&new->data);
         varray_intinit(&new->indx);
+        varray_floatinit(&new->colors);
+        varray_gmatrixinit(&new->matrices);
+        varray_sharedsegmentinit(&new->segments);
+        idmap_init(&new->objectmap);
+        idmap_init(&new->colormap);
+        idmap_init(&new->fontmap);
+        arena_init(&new->arena);
+        new->edited=false;
+        new->listedited=false;
+        new->released=false;
     }
     return new;
 }
 
 /** Free a scene and associated data structures */
 void scene_free(scene *s) {
-    for (unsigned int i=0; i<s->objectlist.count; i++) {
-        gobject *obj = &s->objectlist.data[i];
-        if (obj->vertexdata.format) free(obj->vertexdata.format);
-        varray_gelementclear(&obj->elements);
-    }
-    
     for (unsigned int i=0; i<s->fontlist.count; i++) {
         text_fontclear(&s->fontlist.data[i].font);
     }
     
-    for (unsigned int i=0; i<s->textlist.count; i++) {
-        free(s->textlist.data[i].text);
-    }
-    
     varray_gobjectclear(&s->objectlist);
     varray_gdrawclear(&s->displaylist);
     varray_gcolorclear(&s->colorlist);
@@ -51,6 +53,15 @@ void scene_free(scene *s) {
     varray_gtextclear(&s->textlist);
     varray_floatclear(&s->data);
     varray_intclear(&s->indx);
+    varray_floatclear(&s->colors);
+    varray_gmatrixclear(&s->matrices);
+    idmap_clear(&s->objectmap);
+    idmap_clear(&s->colormap);
+    idmap_clear(&s->fontmap);
+    arena_clear(&s->arena);
+    
+    for (unsigned int i=0; i<s->segments.count; i++) shared_unmap(&s->segments.data[i]);
+    varray_sharedsegmentclear(&s->segments);
     free(s);
 }
 
@@ -67,11 +78,18 @@ scene *scene_find(int id) {
 gobject *scene_addobject(scene *s, int id) {
     gobject obj;
     obj.id=id;
+    obj.vertexdata.format=NULL;
     obj.vertexdata.indx=SCENE_EMPTY;
     obj.vertexdata.length=SCENE_EMPTY;
-    varray_gelementinit(&obj.elements);
+    obj.vertexdata.shared=NULL;
+    obj.vertexdata.dirtystart=0;
+    obj.vertexdata.dirtyend=0;
+    obj.elements.count=0;
+    obj.elements.capacity=0;
+    obj.elements.data=NULL;
     
     varray_gobjectadd(&s->objectlist, &obj, 1);
+    idmap_insert(&s->objectmap, (uint64_t) id, s->objectlist.count-1);
     return &s->objectlist.data[s->objectlist.count-1];
 }
 
@@ -89,10 +107,159 @@ int scene_addindex(scene *s, int *data, int count) {
     return ret;
 }
 
-/** Adds element data to an object */
-int scene_addelement(gobject *obj, gelement *el) {
-    varray_gelementadd(&obj->elements, el, 1);
-    return obj->elements.count-1;
+/** Reserves space for vertex data at the end of a scene's data array
+ *  @param[in] s - the scene
+ *  @param[in] count - number of entries to reserve
+ *  @param[out] indx - starting index of the reserved entries
+ *  @returns a pointer to the reserved entries, to be filled out by the caller, or NULL on failure */
+float *scene_reservedata(scene *s, int count, int *indx) {
+    if (!varray_floatresize(&s->data, count)) return NULL;
+    float *out = s->data.data+s->data.count;
+    if (indx) *indx = s->data.count;
+    s->data.count+=count;
+    return out;
+}
+
+/** Reserves space for index data at the end of a scene's index array
+ *  @param[in] s - the scene
+ *  @param[in] count - number of entries to reserve
+ *  @param[out] indx - starting index of the reserved entries
+ *  @returns a pointer to the reserved entries, to be filled out by the caller, or NULL on failure */
+int *scene_reserveindex(scene *s, int count, int *indx) {
+    if (!varray_intresize(&s->indx, count)) return NULL;
+    int *out = s->indx.data+s->indx.count;
+    if (indx) *indx = s->indx.count;
+    s->indx.count+=count;
+    return out;
+}
+
+/** Releases data reserved by scene_reservedata, from indx onwards */
+void scene_releasedata(scene *s, int indx) {
+    if (indx>=0 && indx<=s->data.count) s->data.count=indx;
+}
+
+/** Releases index data reserved by scene_reserveindex, from indx onwards */
+void scene_releaseindex(scene *s, int indx) {
+    if (indx>=0 && indx<=s->indx.count) s->indx.count=indx;
+}
+
+/** Copies a string into a scene, where it is kept until the scene is freed
+ *  @param[in] s - the scene
+ *  @param[in] str - the string, which needn't be terminated
+ *  @param[in] length - its length in characters
+ *  @returns the terminated copy, or NULL on failure */
+char *scene_addstring(scene *s, const char *str, size_t length) {
+    return arena_string(&s->arena, str, length);
+}
+
+/** Adds element data to an object; the object's element list is grown in the scene's arena
+ *  @returns the index of the element within the object, or -1 on failure */
+int scene_addelement(scene *s, gobject *obj, gelement *el) {
+    gelementlist *list = &obj->elements;
+    
+    if (list->count>=list->capacity) {
+        unsigned int capacity = (list->capacity ? 2*list->capacity : SCENE_MINELEMENTS);
+        gelement *data = arena_grow(&s->arena, list->data, sizeof(gelement)*list->capacity, sizeof(gelement)*capacity);
+        if (!data) return -1;
+        list->data=data;
+        list->capacity=capacity;
+    }
+    
+    list->data[list->count]=*el;
+    return list->count++;
+}
+
+/** Finds data held in shared memory, mapping the segment if the scene doesn't use it already
+ *  @param[in] s - the scene
+ *  @param[in] name - name of the segment
+ *  @param[in] offset - offset of the data in bytes, which must be aligned to 4 bytes
+ *  @param[in] size - size of the data in bytes
+ *  @returns a pointer to the data, or NULL if it isn't available */
+void *scene_shareddata(scene *s, char *name, size_t offset, size_t size) {
+    sharedsegment *seg = NULL;
+    for (unsigned int i=0; i<s->segments.count; i++) {
+        if (strcmp(s->segments.data[i].name, name)==0) seg=&s->segments.data[i];
+    }
+    
+    if (!seg) {
+        sharedsegment new;
+        if (!shared_map(name, &new)) return NULL;
+        if (!varray_sharedsegmentadd(&s->segments, &new, 1)) {
+            shared_unmap(&new);
+            return NULL;
+        }
+        seg=&s->segments.data[s->segments.count-1];
+    }
+    
+    if (offset%4!=0 || offset>seg->size || size>seg->size-offset) {
+        fprintf(stderr, "morphoview: Data lies outside shared memory '%s'.\n", name);
+        return NULL;
+    }
+    
+    return seg->base+offset;
+}
+
+/** Adds vertex or index data held in shared memory to an object
+ *  @param[in] s - the scene
+ *  @param[in] obj - the object
+ *  @param[in] name - name of the segment
+ *  @param[in] offset - offset of the data in bytes
+ *  @param[in] count - number of floats or integers
+ *  @param[in] format - a vertex format, as for vertex data in the scene, or "p", "l" or "f" for a list of indices
+ *  @returns true on success */
+bool scene_addshared(scene *s, gobject *obj, char *name, size_t offset, int count, char *format) {
+    if (count<0) return false;
+    
+    void *data = scene_shareddata(s, name, offset, sizeof(float)*(size_t) count);
+    if (!data) return false;
+    
+    /* A list of indices */
+    if (strlen(format)==1 && strchr("plf", format[0])) {
+        gelement el = { .type = POINTS, .indx = SCENE_EMPTY, .length = count, .shared = data };
+        if (format[0]=='l') el.type=LINES;
+        else if (format[0]=='f') el.type=FACETS;
+        
+        return (scene_addelement(s, obj, &el)>=0);
+    }
+    
+    /* Vertex data can't be split between the scene and shared memory */
+    if (obj->vertexdata.indx!=SCENE_EMPTY || obj->vertexdata.shared) {
+        fprintf(stderr, "morphoview: Object %i already has vertex data.\n", obj->id);
+        return false;
+    }
+    
+    if (format[0]!='\0') {
+        char *copy = scene_addstring(s, format, strlen(format));
+        if (!copy) return false;
+        obj->vertexdata.format=copy;
+    }
+    
+    obj->vertexdata.shared=data;
+    obj->vertexdata.length=count;
+    return true;
+}
+
+/** Finds the segment of shared memory holding some data, or NULL if it isn't in shared memory */
+sharedsegment *scene_findsegment(scene *s, void *data) {
+    for (unsigned int i=0; i<s->segments.count; i++) {
+        sharedsegment *seg = &s->segments.data[i];
+        if ((char *) data>=seg->base && (char *) data<seg->base+seg->size) return seg;
+    }
+    return NULL;
+}
+
+/** Gets an object's vertex data, wherever it is held, or NULL if it has none or it has been released */
+float *scene_vertexdata(scene *s, gobject *obj) {
+    if (s->released) return NULL;
+    if (obj->vertexdata.shared) return obj->vertexdata.shared;
+    return (obj->vertexdata.indx!=SCENE_EMPTY ? s->data.data+obj->vertexdata.indx : NULL);
+}
+
+/** Gets an element's vertex indices, wherever they are held, or NULL if it has none or they have been released */
+int *scene_elementdata(scene *s, gelement *el) {
+    if (s->released) return NULL;
+    if (el->shared) return el->shared;
+    return (el->indx!=SCENE_EMPTY ? s->indx.data+el->indx : NULL);
 }
 
 /** Adds a font to a scene
@@ -105,12 +272,16 @@ bool scene_addfont(scene *s, int id, char *file, float size, int *fontindx) {
     gfont font;
     
     font.id=id;
+    font.size=size;
+    font.file=scene_addstring(s, file, strlen(file));
+    if (!font.file) return false;
     text_fontinit(&font.font, TEXT_DEFAULTWIDTH);
     
     int sizepx = (int) (size / 72.0 * 720.0) /* in pts / points per inch * DPI */;
     
     if (text_openfont(file, sizepx, &font.font)) {
         varray_gfontwrite(&s->fontlist, font);
+        idmap_insert(&s->fontmap, (uint64_t) id, s->fontlist.count-1);
         if (fontindx) *fontindx = s->fontlist.count-1;
         return true;
     }
@@ -120,13 +291,12 @@ bool scene_addfont(scene *s, int id, char *file, float size, int *fontindx) {
 
 /** Find the textfont object corresponding to a given fontid */
 textfont *scene_getfontfromid(scene *s, int fontid) {
-    for (int i=0; i<s->fontlist.count; i++) {
-        if (s->fontlist.data[i].id==fontid) return &s->fontlist.data[i].font;
-    }
+    int i;
+    if (idmap_get(&s->fontmap, (uint64_t) fontid, &i)) return &s->fontlist.data[i].font;
     return NULL;
 }
 
-/** Adds text to a scene */
+/** Adds text to a scene; the text must be held by the scene, e.g. by copying it with scene_addstring */
 int scene_addtext(scene *s, int fontid, char *text) {
     textfont *font = scene_getfontfromid(s, fontid);
 
@@ -144,15 +314,34 @@ int scene_addtext(scene *s, int fontid, char *text) {
     return varray_gtextwrite(&s->textlist, txt);;
 }
 
-/** Adds a color to a scene */
-int scene_addcolor(scene *s, int colorid, int length, int indx) {
+/** Adds a color to a scene
+ *  @param[in] s - the scene
+ *  @param[in] colorid - id of the color
+ *  @param[in] rgb - components of each color, which are copied into the scene's color array
+ *  @param[in] length - number of colors
+ *  @returns the index of the color in the color list, or -1 on failure */
+int scene_addcolor(scene *s, int colorid, float *rgb, int length) {
     gcolor color = { .colorid = colorid,
                      .length = length,
-                     .indx = indx
+                     .indx = s->colors.count
         
     };
     
-    return varray_gcolorwrite(&s->colorlist, color);
+    if (!varray_floatadd(&s->colors, rgb, 3*length)) return -1;
+    
+    int ret=varray_gcolorwrite(&s->colorlist, color);
+    if (ret>=0) idmap_insert(&s->colormap, (uint64_t) colorid, ret);
+    return ret;
+}
+
+/** Adds a model matrix to a scene
+ *  @returns the index of the matrix, by which draw entries refer to it, or SCENE_EMPTY on failure */
+int scene_addmatrix(scene *s, float *matrix) {
+    gmatrix mat;
+    memcpy(mat.m, matrix, sizeof(mat.m));
+    
+    int ret=varray_gmatrixwrite(&s->matrices, mat);
+    return (ret>=0 ? ret : SCENE_EMPTY);
 }
 
 void scene_adddraw(scene *scene, gdrawtype type, int id, int matindx) {
@@ -160,23 +349,241 @@ void scene_adddraw(scene *scene, gdrawtype type, int id, int matindx) {
     varray_gdrawwrite(&scene->displaylist, d);
 }
 
+/* -------------------------------------------------------
+ * Edit
+ * ------------------------------------------------------- */
+
+/** Number of floats taken by an attribute in a vertex format: 'x' for position, 'n' for normal or 'c' for color */
+int scene_attributesize(scene *s, char attribute) {
+    switch (attribute) {
+        case 'x':
+        case 'n': return s->dim;
+        case 'c': return 3;
+        default: return 0;
+    }
+}
+
+/** Records that a range of an object's vertex data has been changed in place */
+void scene_markvertices(scene *s, gobject *obj, int start, int end) {
+    if (obj->vertexdata.dirtystart>=obj->vertexdata.dirtyend) {
+        obj->vertexdata.dirtystart=start;
+        obj->vertexdata.dirtyend=end;
+    } else {
+        if (start<obj->vertexdata.dirtystart) obj->vertexdata.dirtystart=start;
+        if (end>obj->vertexdata.dirtyend) obj->vertexdata.dirtyend=end;
+    }
+    s->edited=true;
+}
+
+/** Replaces an object's vertex data with count entries just added at indx in the scene's data array. Data of the
+ *  same length as the old is copied over it in place and the new entries released, so that the object keeps its
+ *  place in the vertex buffer; otherwise the object refers to the new entries. */
+bool scene_replacevertices(scene *s, gobject *obj, int indx, int count) {
+    if (count<=0) {
+        fprintf(stderr, "morphoview: No vertex data given for object %i.\n", obj->id);
+        return false;
+    }
+    
+    if (!obj->vertexdata.shared && obj->vertexdata.indx!=SCENE_EMPTY && obj->vertexdata.length==count) {
+        memcpy(s->data.data+obj->vertexdata.indx, s->data.data+indx, sizeof(float)*count);
+        scene_releasedata(s, indx);
+    } else {
+        obj->vertexdata.indx=indx;
+        obj->vertexdata.length=count;
+        obj->vertexdata.shared=NULL;
+    }
+    
+    scene_markvertices(s, obj, 0, count);
+    return true;
+}
+
+/** Replaces one attribute of each of an object's vertices, e.g. only their colors, with count entries just added at
+ *  indx in the scene's data array; the new entries are then released. */
+bool scene_replaceattribute(scene *s, gobject *obj, char attribute, int indx, int count) {
+    char *format = obj->vertexdata.format;
+    int size = scene_attributesize(s, attribute), offset = 0, entrysize = 0;
+    bool found = false;
+    
+    for (char *c = format; c && *c!='\0'; c++) {
+        if (*c==attribute) {
+            found=true;
+            offset=entrysize;
+        }
+        entrysize+=scene_attributesize(s, *c);
+    }
+    
+    bool success=false;
+    int nvertices = (entrysize>0 && obj->vertexdata.length>0 ? obj->vertexdata.length/entrysize : 0);
+    
+    if (!found || size==0) {
+        fprintf(stderr, "morphoview: Object %i has no attribute '%c'.\n", obj->id, attribute);
+    } else if (nvertices==0) {
+        fprintf(stderr, "morphoview: Object %i has no vertex data.\n", obj->id);
+    } else if (obj->vertexdata.shared) {
+        fprintf(stderr, "morphoview: Object %i has its vertex data in shared memory.\n", obj->id);
+    } else if (count!=nvertices*size) {
+        fprintf(stderr, "morphoview: Expected %i values for attribute '%c' of object %i.\n", nvertices*size, attribute, obj->id);
+    } else {
+        float *dest = s->data.data+obj->vertexdata.indx+offset;
+        float *src = s->data.data+indx;
+        
+        for (int i=0; i<nvertices; i++) {
+            for (int k=0; k<size; k++) dest[i*entrysize+k]=src[i*size+k];
+        }
+        
+        /* The attribute is interleaved with the others, so the whole block is uploaded again */
+        scene_markvertices(s, obj, 0, obj->vertexdata.length);
+        success=true;
+    }
+    
+    scene_releasedata(s, indx);
+    return success;
+}
+
+/** Whether a draw entry selects a model matrix; entries without one are drawn with the matrix of the entry before */
+static bool scene_drawsmodel(gdraw *drw) {
+    return (drw->type==OBJECT || drw->type==TEXT);
+}
+
+/** Finds the model matrix a draw entry is drawn with
+ *  @returns the index of the matrix, or SCENE_EMPTY for the identity */
+static int scene_effectivematrix(scene *s, unsigned int i) {
+    for (unsigned int j=i+1; j-->0; ) {
+        gdraw *drw = &s->displaylist.data[j];
+        if (scene_drawsmodel(drw) && drw->matindx!=SCENE_EMPTY) return drw->matindx;
+    }
+    return SCENE_EMPTY;
+}
+
+/** Finds the draw entry that inherits the model matrix of entry i; later entries inherit from that one in turn
+ *  @returns the index of the entry, or -1 if the next entry that selects a matrix has its own */
+static int scene_nextinheritor(scene *s, unsigned int i) {
+    for (unsigned int j=i+1; j<s->displaylist.count; j++) {
+        gdraw *drw = &s->displaylist.data[j];
+        if (scene_drawsmodel(drw)) return (drw->matindx==SCENE_EMPTY ? (int) j : -1);
+    }
+    return -1;
+}
+
+/** Sets the model matrix of each draw entry for an object, in place where the entry has one already
+ *  @details Entries that inherited the object's previous matrix are first given a copy of it, so that they don't move.
+ *  @returns the number of entries changed */
+int scene_settransform(scene *s, int id, float *matrix) {
+    int n=0;
+    
+    for (unsigned int i=0; i<s->displaylist.count; i++) {
+        gdraw *drw = &s->displaylist.data[i];
+        if (drw->type!=OBJECT || drw->id!=id) continue;
+        
+        int next=scene_nextinheritor(s, i);
+        if (next>=0) {
+            int effective=scene_effectivematrix(s, i);
+            gmatrix previous;
+            if (effective!=SCENE_EMPTY) previous=s->matrices.data[effective];
+            else mat3d_identity4x4(previous.m);
+            
+            s->displaylist.data[next].matindx=scene_addmatrix(s, previous.m);
+            s->listedited=true;
+        }
+        
+        if (drw->matindx!=SCENE_EMPTY) {
+            memcpy(s->matrices.data[drw->matindx].m, matrix, sizeof(float)*16);
+        } else {
+            drw->matindx=scene_addmatrix(s, matrix);
+            s->listedited=true;
+        }
+        n++;
+    }
+    
+    if (n>0) s->edited=true;
+    return n;
+}
+
+/** Removes the draw entries for an object, keeping the object itself
+ *  @details A removed entry's model matrix passes to the entry that inherited it, so that the others don't move.
+ *  @returns the number of entries removed */
+int scene_removedraws(scene *s, int id) {
+    unsigned int n=0;
+    
+    for (unsigned int i=0; i<s->displaylist.count; i++) {
+        gdraw *drw = &s->displaylist.data[i];
+        if (drw->type==OBJECT && drw->id==id) {
+            int next=scene_nextinheritor(s, i);
+            if (next>=0) s->displaylist.data[next].matindx=drw->matindx;
+            continue;
+        }
+        s->displaylist.data[n++]=*drw;
+    }
+    
+    int removed = s->displaylist.count-n;
+    s->displaylist.count=n;
+    if (removed>0) s->edited=s->listedited=true;
+    return removed;
+}
+
+/** Removes an object together with its draw entries. Pointers to the scene's other objects are invalidated. */
+bool scene_removeobject(scene *s, int id) {
+    for (unsigned int i=0; i<s->objectlist.count; i++) {
+        gobject *obj = &s->objectlist.data[i];
+        if (obj->id!=id) continue;
+        
+        scene_removedraws(s, id);
+        
+        /* The object's format and elements stay in the arena until the scene is freed */
+        memmove(obj, obj+1, sizeof(gobject)*(s->objectlist.count-i-1));
+        s->objectlist.count--;
+        
+        /* Objects after the one removed have moved */
+        idmap_empty(&s->objectmap);
+        for (unsigned int j=0; j<s->objectlist.count; j++) {
+            idmap_insert(&s->objectmap, (uint64_t) s->objectlist.data[j].id, j);
+        }
+        
+        s->edited=s->listedited=true;
+        return true;
+    }
+    return false;
+}
+
+/** Clears the record of changes made in place, once they have been applied */
+void scene_clearedits(scene *s) {
+    for (unsigned int i=0; i<s->objectlist.count; i++) {
+        s->objectlist.data[i].vertexdata.dirtystart=0;
+        s->objectlist.data[i].vertexdata.dirtyend=0;
+    }
+    s->edited=false;
+    s->listedited=false;
+}
+
+/** @brief Frees a scene's vertex and element data, and unmaps its shared memory, once they have been uploaded
+ *  @details The objects keep the positions and lengths of their data, so the layout of the scene is unchanged, but
+ *  scene_vertexdata and scene_elementdata return NULL from now on. Colors, matrices and text are kept, as the render
+ *  list refers to them. The scene can't be edited or prepared again afterwards. */
+void scene_releasegeometry(scene *s) {
+    varray_floatclear(&s->data);
+    varray_intclear(&s->indx);
+    
+    for (unsigned int i=0; i<s->segments.count; i++) shared_unmap(&s->segments.data[i]);
+    varray_sharedsegmentclear(&s->segments);
+    
+    s->released=true;
+}
+
 /* -------------------------------------------------------
  * Find
  * ------------------------------------------------------- */
 
 /** Gets a gobject structure given an id */
 gobject *scene_getgobjectfromid(scene *s, int id) {
-    for (unsigned int i=0; i<s->objectlist.count; i++) {
-        if (s->objectlist.data[i].id==id) return &s->objectlist.data[i];
-    }
+    int i;
+    if (idmap_get(&s->objectmap, (uint64_t) id, &i)) return &s->objectlist.data[i];
     return NULL;
 }
 
 /** Gets a gcolor structure given an id */
 gcolor *scene_getcolorfromid(scene *s, int id) {
-    for (unsigned int i=0; i<s->colorlist.count; i++) {
-        if (s->colorlist.data[i].colorid==id) return &s->colorlist.data[i];
-    }
+    int i;
+    if (idmap_get(&s->colormap, (uint64_t) id, &i)) return &s->colorlist.data[i];
     return NULL;
 }
 
@@ -185,13 +592,44 @@ gcolor *scene_getcolorfromid(scene *s, int id) {
  * ------------------------------------------------------- */
 
 DEFINE_VARRAY(gobject, gobject);
-DEFINE_VARRAY(gelement, gelement);
 DEFINE_VARRAY(gcolor, gcolor);
+DEFINE_VARRAY(gmatrix, gmatrix);
 DEFINE_VARRAY(gfont, gfont);
 DEFINE_VARRAY(gdraw, gdraw);
 DEFINE_VARRAY(gtext, gtext);
 DEFINE_VARRAY(float, float);
 
+/* -------------------------------------------------------
+ * Scene sinks
+ * ------------------------------------------------------- */
+
+/** Hands a new scene to a sink, returning its handle */
+void *scene_sinkopen(scenesink *sink, scene *s) {
+    if (sink && sink->open) return sink->open(sink->ref, s);
+    return NULL;
+}
+
+/** Passes the title of a scene to a sink */
+void scene_sinksettitle(scenesink *sink, void *handle, char *title) {
+    if (sink && sink->settitle) sink->settitle(sink->ref, handle, title);
+}
+
+/** Tells a sink that a scene is ready to be prepared for use */
+void scene_sinkprepare(scenesink *sink, void *handle, scene *s) {
+    if (sink && sink->prepare) sink->prepare(sink->ref, handle, s);
+}
+
+/** Checks whether a sink is still using a scene */
+bool scene_sinkisopen(scenesink *sink, void *handle) {
+    if (sink && sink->isopen) return sink->isopen(sink->ref, handle);
+    return true;
+}
+
+/** Gives a sink the opportunity to update while waiting for input */
+void scene_sinkupdate(scenesink *sink) {
+    if (sink && sink->update) sink->update(sink->ref);
+}
+
 /* -------------------------------------------------------
  * Initialize/Finalize
  * ------------------------------------------------------- */
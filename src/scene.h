@@ -10,8 +10,14 @@
 #include <stdio.h>
 #include "varray.h"
 #include "text.h"
+#include "shared.h"
+#include "idmap.h"
+#include "arena.h"
 
 #define SCENE_EMPTY -1
+
+/** Number of elements an object's element list first has room for */
+#define SCENE_MINELEMENTS 4
 DECLARE_VARRAY(float, float);
 
 /* **********************
@@ -28,9 +34,15 @@ typedef struct {
     gelementtype type; 
     int indx;
     int length; 
+    int *shared; /** Indices held in shared memory, or NULL if they are in the scene's index array */
 } gelement;
 
-DECLARE_VARRAY(gelement, gelement);
+/** @brief The elements of an object, held in the scene's arena */
+typedef struct {
+    unsigned int count;
+    unsigned int capacity;
+    gelement *data;
+} gelementlist;
 
 /* **********************
  * Objects
@@ -39,11 +51,13 @@ DECLARE_VARRAY(gelement, gelement);
 typedef struct {
     int id;
     struct {
-        char *format;
+        char *format; /** Held in the scene's arena */
         int indx;
         int length;
+        float *shared; /** Vertex data held in shared memory, or NULL if it is in the scene's data array */
+        int dirtystart, dirtyend; /** Range of vertex data changed in place since the object was last prepared */
     } vertexdata;
-    varray_gelement elements;
+    gelementlist elements;
 } gobject;
 
 DECLARE_VARRAY(gobject, gobject);
@@ -54,18 +68,31 @@ DECLARE_VARRAY(gobject, gobject);
 
 typedef struct {
     int colorid;
-    int indx;
-    int length;
+    int indx; /** Index of the first component in the scene's color array */
+    int length; /** Number of colors */
 } gcolor;
 
 DECLARE_VARRAY(gcolor, gcolor);
 
+/* **********************
+ * Model matrices
+ * ********************** */
+
+/** @brief A 4x4 model matrix in column major order */
+typedef struct {
+    float m[16];
+} gmatrix;
+
+DECLARE_VARRAY(gmatrix, gmatrix);
+
 /* **********************
  * Fonts
  * ********************** */
 
 typedef struct {
     int id;
+    char *file; /** Font file, kept so that the scene can be written out again; held in the scene's arena */
+    float size; /** Size in points */
     textfont font;
 } gfont;
 
@@ -77,7 +104,7 @@ DECLARE_VARRAY(gfont, gfont);
 
 typedef struct {
     int fontid;
-    char *text;
+    char *text; /** Held in the scene's arena */
 } gtext;
 
 DECLARE_VARRAY(gtext, gtext);
@@ -95,7 +122,7 @@ typedef enum {
 typedef struct {
     gdrawtype type;
     int id;
-    int matindx;
+    int matindx; /** Index of the model matrix in the scene's matrix array, or SCENE_EMPTY */
 } gdraw;
 
 DECLARE_VARRAY(gdraw, gdraw);
@@ -110,16 +137,46 @@ typedef struct sscene {
     int id; /** The scene ID */
     int dim; /** Number of dimensions; 2 or 3 */
     
-    varray_float data;
-    varray_int indx;
+    varray_float data; /** Vertex data */
+    varray_int indx; /** Element indices */
+    varray_float colors; /** Color components, three for each color */
+    varray_gmatrix matrices; /** Model matrices */
     varray_gobject objectlist;
     varray_gcolor colorlist;
     varray_gfont fontlist;
     varray_gtext textlist;
     
     varray_gdraw displaylist;
+    
+    idmap objectmap; /** Position of each object in the object list by id */
+    idmap colormap; /** Position of each color in the color list by id */
+    idmap fontmap; /** Position of each font in the font list by id */
+    
+    varray_sharedsegment segments; /** Shared memory mapped for the scene */
+    
+    arena arena; /** Strings and element lists, freed with the scene */
+    
+    bool edited; /** Whether the scene has been changed in place since it was last prepared */
+    bool listedited; /** Whether entries in the display list have been changed or removed */
+    bool released; /** Whether vertex and element data have been freed after being uploaded */
 } scene;
 
+/* ***************************
+ * Scene sinks
+ * *************************** */
+
+/** @brief Receives scenes from a parser as they are built, so that parsers needn't know how scenes are used.
+ *  @details open is called as each scene is begun, and takes ownership of it; the handle it returns, which may be
+ *  NULL, is passed to the other callbacks for that scene. Any of the callbacks may be NULL. */
+typedef struct {
+    void *(*open) (void *ref, scene *s); /** A scene has begun */
+    void (*settitle) (void *ref, void *handle, char *title); /** A title has been given for the scene */
+    void (*prepare) (void *ref, void *handle, scene *s); /** The scene is complete, or has grown while streaming */
+    bool (*isopen) (void *ref, void *handle); /** Whether the scene is still in use */
+    void (*update) (void *ref); /** Called periodically while waiting for streamed input */
+    void *ref; /** Passed to each of the callbacks */
+} scenesink;
+
 scene *scene_new(int id, int dim);
 scene *scene_find(int id);
 void scene_free(scene *s);
@@ -127,16 +184,43 @@ void scene_free(scene *s);
 gobject *scene_addobject(scene *s, int id);
 int scene_adddata(scene *s, float *data, int count);
 int scene_addindex(scene *s, int *data, int count);
-int scene_addelement(gobject *obj, gelement *el);
+float *scene_reservedata(scene *s, int count, int *indx);
+int *scene_reserveindex(scene *s, int count, int *indx);
+void scene_releasedata(scene *s, int indx);
+void scene_releaseindex(scene *s, int indx);
+char *scene_addstring(scene *s, const char *str, size_t length);
+int scene_addelement(scene *s, gobject *obj, gelement *el);
+void *scene_shareddata(scene *s, char *name, size_t offset, size_t size);
+bool scene_addshared(scene *s, gobject *obj, char *name, size_t offset, int count, char *format);
+sharedsegment *scene_findsegment(scene *s, void *data);
+float *scene_vertexdata(scene *s, gobject *obj);
+int *scene_elementdata(scene *s, gelement *el);
 bool scene_addfont(scene *s, int id, char *file, float size, int *fontindx);
 textfont *scene_getfontfromid(scene *s, int fontid);
 int scene_addtext(scene *s, int fontid, char *text);
-int scene_addcolor(scene *s, int colorid, int length, int indx);
+int scene_addcolor(scene *s, int colorid, float *rgb, int length);
+int scene_addmatrix(scene *s, float *matrix);
 void scene_adddraw(scene *scene, gdrawtype type, int id, int matindx);
 
+int scene_attributesize(scene *s, char attribute);
+void scene_markvertices(scene *s, gobject *obj, int start, int end);
+bool scene_replacevertices(scene *s, gobject *obj, int indx, int count);
+bool scene_replaceattribute(scene *s, gobject *obj, char attribute, int indx, int count);
+int scene_settransform(scene *s, int id, float *matrix);
+int scene_removedraws(scene *s, int id);
+bool scene_removeobject(scene *s, int id);
+void scene_clearedits(scene *s);
+void scene_releasegeometry(scene *s);
+
 gobject *scene_getgobjectfromid(scene *s, int id);
 gcolor *scene_getcolorfromid(scene *s, int id);
 
+void *scene_sinkopen(scenesink *sink, scene *s);
+void scene_sinksettitle(scenesink *sink, void *handle, char *title);
+void scene_sinkprepare(scenesink *sink, void *handle, scene *s);
+bool scene_sinkisopen(scenesink *sink, void *handle);
+void scene_sinkupdate(scenesink *sink);
+
 void scene_initialize(void);
 void scene_finalize(void);
 
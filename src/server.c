@@ -0,0 +1,277 @@
+/** @file server.c
+ *  @author T J Atherton
+ *
+ *  @brief Persistent viewer that displays scenes sent to it over a local socket
+ *  @details Each connection carries a command file, in text or binary format, which is parsed as it arrives just as a
+ *           pipe is. A scene reuses the window already showing a scene with the same id, keeping its view, unless
+ *           another connection is still drawing into it. As the process persists, shaders and font faces are loaded
+ *           once and shared by every window.
+ *
+ *  Clients can send a file with, e.g., nc -U $XDG_RUNTIME_DIR/morphoview.sock < file.draw
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "server.h"
+#include "command.h"
+#include "display.h"
+#include "varray.h"
+
+#ifdef SERVER_SOCKETS
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* -------------------------------------------------------
+ * Connections
+ * ------------------------------------------------------- */
+
+/** @brief A client connection */
+typedef struct {
+    int fd; /** Socket for the connection */
+    commandstream stream; /** Parser for the input received so far */
+} serverconnection;
+
+DECLARE_VARRAY(serverconnection, serverconnection *);
+DEFINE_VARRAY(serverconnection, serverconnection *);
+
+DECLARE_VARRAY(pollfd, struct pollfd);
+DEFINE_VARRAY(pollfd, struct pollfd);
+
+/** Open connections */
+static varray_serverconnection connections;
+
+/** Set by a signal to stop the server */
+static volatile sig_atomic_t serverquit = 0;
+
+/** Closes a connection and removes it from the list */
+static void server_close(unsigned int i) {
+    serverconnection *c = connections.data[i];
+    close(c->fd);
+    command_streamclear(&c->stream);
+    free(c);
+    
+    connections.data[i]=connections.data[connections.count-1];
+    connections.count--;
+}
+
+/** Checks whether a connection is still drawing into a display */
+static bool server_isdrawing(display *d) {
+    for (unsigned int i=0; i<connections.count; i++) {
+        parser *p = &connections.data[i]->stream.p;
+        if (p->view==d && p->scene==d->s) return true;
+    }
+    return false;
+}
+
+/* -------------------------------------------------------
+ * Scene sink
+ * ------------------------------------------------------- */
+
+/** Shows a scene in the window already showing a scene with the same id if possible, or else a new window */
+static void *server_sinkopen(void *ref, scene *s) {
+    display *d = display_findscene(s->id);
+    if (d && !server_isdrawing(d)) {
+        display_setscene(d, s);
+        return d;
+    }
+    return display_open(s);
+}
+
+/** Receives scenes from every connection */
+static scenesink serversink;
+
+/* -------------------------------------------------------
+ * Socket
+ * ------------------------------------------------------- */
+
+/** Finds the default path for the socket */
+static bool server_defaultpath(char *path, size_t size) {
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    int n;
+    
+    if (dir && dir[0]!='\0') n=snprintf(path, size, "%s/%s", dir, SERVER_SOCKET);
+    else n=snprintf(path, size, "/tmp/morphoview-%u.sock", (unsigned int) getuid());
+    
+    return (n>0 && (size_t) n<size);
+}
+
+/** Checks whether a server is already listening on a socket */
+static bool server_islistening(struct sockaddr_un *addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd<0) return false;
+    
+    bool listening = (connect(fd, (struct sockaddr *) addr, sizeof(struct sockaddr_un))==0);
+    close(fd);
+    return listening;
+}
+
+/** Creates a socket listening at a given path, replacing a stale socket left by an earlier server
+ *  @returns the socket, or -1 on failure */
+static int server_listen(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    if (strlen(path)>=sizeof(addr.sun_path)) {
+        fprintf(stderr, "morphoview: Socket path %s is too long.\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    
+    if (server_islistening(&addr)) {
+        fprintf(stderr, "morphoview: A server is already listening on %s.\n", path);
+        return -1;
+    }
+    unlink(path);
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd<0 ||
+        bind(fd, (struct sockaddr *) &addr, sizeof(addr))!=0 ||
+        listen(fd, SERVER_BACKLOG)!=0) {
+        fprintf(stderr, "morphoview: Couldn't listen on %s: %s.\n", path, strerror(errno));
+        if (fd>=0) close(fd);
+        return -1;
+    }
+    
+    return fd;
+}
+
+/** Accepts a new connection */
+static void server_accept(int listener) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd<0) return;
+    
+    serverconnection *c = malloc(sizeof(serverconnection));
+    if (!c || !varray_serverconnectionadd(&connections, &c, 1)) {
+        fprintf(stderr, "morphoview: Couldn't allocate connection.\n");
+        free(c);
+        close(fd);
+        return;
+    }
+    
+    c->fd=fd;
+    command_streaminit(&c->stream, &serversink);
+}
+
+/** Reads available input from a connection
+ *  @returns false if the connection should be closed */
+static bool server_read(serverconnection *c) {
+    char chunk[COMMAND_READCHUNK];
+    ssize_t n = read(c->fd, chunk, sizeof(chunk));
+    
+    if (n>0) return command_streamfeed(&c->stream, chunk, (size_t) n);
+    if (n<0 && (errno==EINTR || errno==EAGAIN)) return true;
+    
+    if (n==0) command_streamfinish(&c->stream); /* End of input */
+    else fprintf(stderr, "morphoview: Error reading from connection: %s.\n", strerror(errno));
+    return false;
+}
+
+/** Stops the server on an interrupt */
+static void server_signal(int sig) {
+    serverquit=1;
+}
+
+/* -------------------------------------------------------
+ * Server loop
+ * ------------------------------------------------------- */
+
+/** Runs the server until interrupted
+ *  @param[in] path - path of the socket, or NULL for the default
+ *  @returns true on success */
+bool server_run(const char *path) {
+    char defaultpath[SERVER_MAXPATH];
+    if (!path) {
+        if (!server_defaultpath(defaultpath, sizeof(defaultpath))) {
+            fprintf(stderr, "morphoview: Couldn't find a path for the socket.\n");
+            return false;
+        }
+        path=defaultpath;
+    }
+    
+    int listener = server_listen(path);
+    if (listener<0) return false;
+    
+    display_sink(&serversink);
+    serversink.open=server_sinkopen;
+    serversink.update=NULL; /* The server loop updates the displays */
+    
+    varray_serverconnectioninit(&connections);
+    signal(SIGINT, server_signal);
+    signal(SIGTERM, server_signal);
+    signal(SIGPIPE, SIG_IGN);
+    
+    printf("morphoview: Listening on %s\n", path);
+    fflush(stdout);
+    
+    bool success=true;
+    varray_pollfd fds;
+    varray_pollfdinit(&fds);
+    
+    while (!serverquit) {
+        /* Wait briefly for input, so that the windows stay responsive */
+        fds.count=0;
+        struct pollfd lfd = { .fd = listener, .events = POLLIN };
+        varray_pollfdwrite(&fds, lfd);
+        for (unsigned int i=0; i<connections.count; i++) {
+            struct pollfd cfd = { .fd = connections.data[i]->fd, .events = POLLIN };
+            varray_pollfdwrite(&fds, cfd);
+        }
+        if (fds.count<=connections.count) {
+            fprintf(stderr, "morphoview: Couldn't allocate connection list.\n");
+            success=false;
+            break;
+        }
+        
+        int nconnections = (int) connections.count;
+        if (poll(fds.data, fds.count, COMMAND_STREAMWAIT)<0 && errno!=EINTR) {
+            fprintf(stderr, "morphoview: Error waiting for input: %s.\n", strerror(errno));
+            success=false;
+            break;
+        }
+        
+        /* Connections are removed by swapping with the last, so work backwards */
+        for (int i=nconnections-1; i>=0; i--) {
+            serverconnection *c = connections.data[i];
+            if (fds.data[i+1].revents) {
+                if (!server_read(c)) server_close(i);
+            } else { /* Show whatever has arrived while waiting for more */
+                command_streampublish(&c->stream, true);
+            }
+        }
+        
+        if (fds.data[0].revents & POLLIN) server_accept(listener);
+        
+        display_update();
+        
+        /* Drop connections whose windows have been closed, as this frees their scenes */
+        for (int i=(int) connections.count-1; i>=0; i--) {
+            parser *p = &connections.data[i]->stream.p;
+            if (p->scene && !display_isopen(p->view)) server_close(i);
+        }
+    }
+    
+    while (connections.count>0) server_close(connections.count-1);
+    varray_serverconnectionclear(&connections);
+    varray_pollfdclear(&fds);
+    
+    close(listener);
+    unlink(path);
+    
+    return success;
+}
+
+#else
+
+bool server_run(const char *path) {
+    fprintf(stderr, "morphoview: Server mode isn't supported on this platform.\n");
+    return false;
+}
+
+#endif
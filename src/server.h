@@ -0,0 +1,32 @@
+/** @file server.h
+ *  @author T J Atherton
+ *
+ *  @brief Persistent viewer that displays scenes sent to it over a local socket
+ */
+
+#ifndef server_h
+#define server_h
+
+#include <stdbool.h>
+
+/** Use UNIX domain sockets where available */
+#ifndef _WIN32
+#define SERVER_SOCKETS
+#endif
+
+/** Name of the socket within the user's runtime directory */
+#define SERVER_SOCKET "morphoview.sock"
+
+/** Maximum length of the socket path */
+#define SERVER_MAXPATH 108
+
+/** Number of pending connections the socket queues */
+#define SERVER_BACKLOG 16
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+bool server_run(const char *path);
+
+#endif /* server_h */
@@ -0,0 +1,84 @@
+/** @file shared.c
+ *  @author T J Atherton
+ *
+ *  @brief Shared memory segments holding scene data written by another process
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shared.h"
+
+#ifdef SHARED_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+DEFINE_VARRAY(sharedsegment, sharedsegment);
+
+/* A producer, such as morpho, writes vertex and index data into a segment of shared memory and sends the viewer
+   a short descriptor in its place. Segments are named either as for shm_open, e.g. "/mesh", or by the path of a
+   file to map, which allows a memfd to be passed as /proc/<pid>/fd/<n>. Segments are mapped read only for the
+   lifetime of the scene, so the producer may unlink a segment once the viewer has read the commands that use it. */
+
+#ifdef SHARED_POSIX
+/** Opens a segment by name
+ *  @returns a file descriptor, or -1 on failure */
+static int shared_open(const char *name) {
+    if (name[0]=='/' && strchr(name+1, '/')) return open(name, O_RDONLY);
+    return shm_open(name, O_RDONLY, 0);
+}
+#endif
+
+/** Maps a segment of shared memory
+ *  @param[in] name - name of the segment
+ *  @param[out] out - filled out with the mapping
+ *  @returns true on success */
+bool shared_map(const char *name, sharedsegment *out) {
+#ifdef SHARED_POSIX
+    int fd = shared_open(name);
+    if (fd<0) {
+        fprintf(stderr, "morphoview: Couldn't open shared memory '%s': %s.\n", name, strerror(errno));
+        return false;
+    }
+    
+    struct stat st;
+    bool success=(fstat(fd, &st)==0 && st.st_size>0);
+    if (success) {
+        out->size=(size_t) st.st_size;
+        out->base=mmap(NULL, out->size, PROT_READ, MAP_SHARED, fd, 0);
+        success=(out->base!=MAP_FAILED);
+    }
+    close(fd);
+    
+    if (success) {
+        out->name=malloc(strlen(name)+1);
+        if (out->name) strcpy(out->name, name);
+        else {
+            munmap(out->base, out->size);
+            success=false;
+        }
+    }
+    
+    if (!success) fprintf(stderr, "morphoview: Couldn't map shared memory '%s'.\n", name);
+    return success;
+#else
+    fprintf(stderr, "morphoview: Shared memory isn't supported on this platform.\n");
+    return false;
+#endif
+}
+
+/** Unmaps a segment of shared memory */
+void shared_unmap(sharedsegment *seg) {
+#ifdef SHARED_POSIX
+    if (seg->base) munmap(seg->base, seg->size);
+#endif
+    free(seg->name);
+    seg->name=NULL;
+    seg->base=NULL;
+    seg->size=0;
+}
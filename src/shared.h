@@ -0,0 +1,35 @@
+/** @file shared.h
+ *  @author T J Atherton
+ *
+ *  @brief Shared memory segments holding scene data written by another process
+ */
+
+#ifndef shared_h
+#define shared_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "varray.h"
+
+/** Use POSIX shared memory where available */
+#ifndef _WIN32
+#define SHARED_POSIX
+#endif
+
+/** @brief A segment of shared memory mapped into the viewer */
+typedef struct {
+    char *name; /** Name of the segment */
+    char *base; /** Start of the mapping */
+    size_t size; /** Size of the mapping in bytes */
+} sharedsegment;
+
+DECLARE_VARRAY(sharedsegment, sharedsegment);
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+bool shared_map(const char *name, sharedsegment *out);
+void shared_unmap(sharedsegment *seg);
+
+#endif /* shared_h */
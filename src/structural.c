@@ -0,0 +1,391 @@
+/** @file structural.c
+ *  @author T J Atherton
+ *
+ *  @brief Vectorized structural index for the command language lexer
+ */
+
+#include <string.h>
+#include "structural.h"
+
+/* Command files consist almost entirely of white space separated numbers. Rather than examining these a character
+   at a time, the input is classified in blocks of 64 characters using SIMD comparisons where available, producing
+   bitmaps that locate token boundaries and the extent of runs of numbers. The lexer then jumps between token starts,
+   and the parser counts a run of numbers with a population count. */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define STRUCTURAL_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define STRUCTURAL_SSE2
+#endif
+
+/** @brief Classification of a block of 64 characters, one bit per character */
+typedef struct {
+    uint64_t space; /* White space */
+    uint64_t quote; /* Quotation marks */
+    uint64_t other; /* Characters that can't occur in a run of numbers */
+    uint64_t fraction; /* Characters that only occur in floats */
+    uint64_t exponent; /* Exponent markers */
+    uint64_t sign; /* Signs */
+} structuralblock;
+
+/* -------------------------------------------------------
+ * Bit manipulation
+ * ------------------------------------------------------- */
+
+/** Index of the lowest set bit of a nonzero word */
+static int structural_lowestbit(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n=0;
+    for (; !(x & 1); x>>=1) n++;
+    return n;
+#endif
+}
+
+/** Index of the highest set bit of a nonzero word */
+static int structural_highestbit(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63-__builtin_clzll(x);
+#else
+    int n=0;
+    for (; x>1; x>>=1) n++;
+    return n;
+#endif
+}
+
+/** Number of set bits in a word */
+static int structural_popcount(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    int n=0;
+    for (; x; x&=x-1) n++;
+    return n;
+#endif
+}
+
+/** Sets each bit to the parity of the bits at or below it; marks characters from an opening quote up to its closing quote */
+static uint64_t structural_prefixxor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/* -------------------------------------------------------
+ * Classify blocks
+ * ------------------------------------------------------- */
+
+#if defined(STRUCTURAL_AVX2)
+
+/** Classifies a block of 64 characters using AVX2 */
+static void structural_classify(const char *in, structuralblock *b) {
+    b->space=b->quote=b->other=b->fraction=b->exponent=b->sign=0;
+
+    for (int i=0; i<2; i++) {
+        __m256i c = _mm256_loadu_si256((const __m256i *) (in + 32*i));
+
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')),
+                                         _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('\t'-1)),
+                                                          _mm256_cmpgt_epi8(_mm256_set1_epi8('\r'+1), c)));
+        __m256i quote = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('"'));
+        __m256i exponent = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('e')),
+                                           _mm256_cmpeq_epi8(c, _mm256_set1_epi8('E')));
+        __m256i fraction = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('.')), exponent);
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0'-1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9'+1), c));
+        __m256i sign = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('-')),
+                                       _mm256_cmpeq_epi8(c, _mm256_set1_epi8('+')));
+        __m256i numeric = _mm256_or_si256(_mm256_or_si256(digit, sign), _mm256_or_si256(fraction, space));
+
+        int shift = 32*i;
+        b->space |= ((uint64_t) (uint32_t) _mm256_movemask_epi8(space)) << shift;
+        b->quote |= ((uint64_t) (uint32_t) _mm256_movemask_epi8(quote)) << shift;
+        b->fraction |= ((uint64_t) (uint32_t) _mm256_movemask_epi8(fraction)) << shift;
+        b->exponent |= ((uint64_t) (uint32_t) _mm256_movemask_epi8(exponent)) << shift;
+        b->sign |= ((uint64_t) (uint32_t) _mm256_movemask_epi8(sign)) << shift;
+        b->other |= ((uint64_t) (uint32_t) ~_mm256_movemask_epi8(numeric)) << shift;
+    }
+}
+
+#elif defined(STRUCTURAL_SSE2)
+
+/** Classifies a block of 64 characters using SSE2 */
+static void structural_classify(const char *in, structuralblock *b) {
+    b->space=b->quote=b->other=b->fraction=b->exponent=b->sign=0;
+
+    for (int i=0; i<4; i++) {
+        __m128i c = _mm_loadu_si128((const __m128i *) (in + 16*i));
+
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')),
+                                     _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('\t'-1)),
+                                                   _mm_cmplt_epi8(c, _mm_set1_epi8('\r'+1))));
+        __m128i quote = _mm_cmpeq_epi8(c, _mm_set1_epi8('"'));
+        __m128i exponent = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('e')),
+                                        _mm_cmpeq_epi8(c, _mm_set1_epi8('E')));
+        __m128i fraction = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('.')), exponent);
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0'-1)),
+                                      _mm_cmplt_epi8(c, _mm_set1_epi8('9'+1)));
+        __m128i sign = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('-')),
+                                    _mm_cmpeq_epi8(c, _mm_set1_epi8('+')));
+        __m128i numeric = _mm_or_si128(_mm_or_si128(digit, sign), _mm_or_si128(fraction, space));
+
+        int shift = 16*i;
+        b->space |= ((uint64_t) (uint16_t) _mm_movemask_epi8(space)) << shift;
+        b->quote |= ((uint64_t) (uint16_t) _mm_movemask_epi8(quote)) << shift;
+        b->fraction |= ((uint64_t) (uint16_t) _mm_movemask_epi8(fraction)) << shift;
+        b->exponent |= ((uint64_t) (uint16_t) _mm_movemask_epi8(exponent)) << shift;
+        b->sign |= ((uint64_t) (uint16_t) _mm_movemask_epi8(sign)) << shift;
+        b->other |= ((uint64_t) (uint16_t) ~_mm_movemask_epi8(numeric)) << shift;
+    }
+}
+
+#else
+
+/** Classifies a block of 64 characters one at a time */
+static void structural_classify(const char *in, structuralblock *b) {
+    b->space=b->quote=b->other=b->fraction=b->exponent=b->sign=0;
+
+    for (int i=0; i<64; i++) {
+        char c = in[i];
+        uint64_t bit = ((uint64_t) 1) << i;
+
+        if (c==' ' || (c>='\t' && c<='\r')) b->space |= bit;
+        else if (c=='.') b->fraction |= bit;
+        else if (c=='e' || c=='E') {
+            b->fraction |= bit;
+            b->exponent |= bit;
+        } else if (c=='-' || c=='+') b->sign |= bit;
+        else if (!(c>='0' && c<='9')) {
+            b->other |= bit;
+            if (c=='"') b->quote |= bit;
+        }
+    }
+}
+
+#endif
+
+/* -------------------------------------------------------
+ * Build the index
+ * ------------------------------------------------------- */
+
+/** Builds the window of the index starting at s->wstart */
+static void structural_buildwindow(structuralindex *s) {
+    size_t remaining = s->length - s->wstart;
+    s->wlength = (remaining<STRUCTURAL_WINDOW ? remaining : STRUCTURAL_WINDOW);
+    const char *in = s->start + s->wstart;
+
+    for (size_t w=0; w<STRUCTURAL_WORDS; w++) {
+        size_t offset = 64*w;
+
+        if (offset>=s->wlength) { /* Past the end of the input */
+            s->tokens[w]=0;
+            s->other[w]=UINT64_MAX;
+            s->fraction[w]=0;
+            s->glued[w]=0;
+            continue;
+        }
+
+        structuralblock b;
+        uint64_t valid = UINT64_MAX;
+
+        if (offset+64<=s->wlength) {
+            structural_classify(in+offset, &b);
+        } else { /* Copy the final partial block so as not to read past the end of the input */
+            char pad[64];
+            size_t n = s->wlength-offset;
+            memset(pad, 0, sizeof(pad));
+            memcpy(pad, in+offset, n);
+            structural_classify(pad, &b);
+            valid = (((uint64_t) 1) << n) - 1;
+        }
+
+        /* Token starts follow white space... */
+        uint64_t prevspace = (b.space << 1) | (s->prevspace ? 1 : 0);
+        s->prevspace = (b.space >> 63);
+
+        /* ...and aren't within strings, which extend from an opening quote up to the closing quote */
+        uint64_t instring = structural_prefixxor(b.quote) ^ (s->instring ? UINT64_MAX : 0);
+        s->instring = (instring >> 63);
+        uint64_t interior = instring & ~b.quote;
+        uint64_t closing = b.quote & ~instring;
+
+        /* Numbers start with a digit or a sign, so an exponent marker that starts a token is a command, as in "E 1" */
+        uint64_t command = b.exponent & prevspace & ~interior;
+        uint64_t exponent = b.exponent & ~command;
+
+        /* Signs must start a number or its exponent; others join two numbers together, as in "3-4" */
+        uint64_t prevexponent = (exponent << 1) | (s->prevexponent ? 1 : 0);
+        s->prevexponent = (exponent >> 63);
+
+        s->tokens[w] = ~b.space & prevspace & ~interior & ~closing & valid;
+        s->other[w] = b.other | command | ~valid;
+        s->fraction[w] = b.fraction & ~command & valid;
+        s->glued[w] = b.sign & ~prevspace & ~prevexponent & valid;
+    }
+}
+
+/** Moves the index on to the next window */
+static void structural_nextwindow(structuralindex *s) {
+    s->wstart+=STRUCTURAL_WINDOW;
+    structural_buildwindow(s);
+}
+
+/** Initializes a structural index
+ *  @param[in] s - the index
+ *  @param[in] start - the input, which must be followed by a terminator
+ *  @param[in] length - length of the input */
+void structural_init(structuralindex *s, const char *start, size_t length) {
+    s->start=start;
+    s->length=length;
+    s->wstart=0;
+    s->prevspace=true;
+    s->prevexponent=false;
+    s->instring=false;
+    structural_buildwindow(s);
+}
+
+/* -------------------------------------------------------
+ * Use the index
+ * ------------------------------------------------------- */
+
+/** Checks if a character is white space */
+static bool structural_isspace(char c) {
+    return (c==' ' || (c>='\t' && c<='\r'));
+}
+
+/** Finds the next token after a white space character
+ *  @param[in] s - the index
+ *  @param[in] c - a white space character
+ *  @returns the start of the next token, or the terminator */
+const char *structural_skipspace(structuralindex *s, const char *c) {
+    size_t pos = (size_t) (c - s->start);
+
+    /* The index only moves forward; skip anything it no longer covers a character at a time */
+    for (; pos<s->wstart; pos++) {
+        if (!structural_isspace(s->start[pos])) return s->start+pos;
+    }
+
+    while (pos<s->length) {
+        if (pos>=s->wstart+STRUCTURAL_WINDOW) {
+            structural_nextwindow(s);
+            continue;
+        }
+
+        size_t rel = pos - s->wstart;
+        size_t w = rel/64;
+        uint64_t bits = s->tokens[w] & (UINT64_MAX << (rel%64));
+
+        while (!bits && ++w<STRUCTURAL_WORDS) bits = s->tokens[w];
+        if (bits) return s->start + s->wstart + 64*w + structural_lowestbit(bits);
+
+        pos = s->wstart+STRUCTURAL_WINDOW;
+    }
+
+    return s->start+s->length;
+}
+
+/** Mask of the bits below bit b of a word, where b may be up to 64 */
+static uint64_t structural_below(size_t b) {
+    return (b>=64 ? UINT64_MAX : (((uint64_t) 1) << b) - 1);
+}
+
+/** Counts a segment of a run of numbers from the index
+ *  @details Runs are assumed to consist of white space separated numbers; the caller should verify this as it converts them.
+ *           The first number must also follow white space, as the index only counts numbers that do; one joined to
+ *           the token before it, as in f1 2 3, isn't counted.
+ *  @param[in] s - the index
+ *  @param[in] c - start of the first number in the segment
+ *  @param[in] integers - whether the run ends at the first float
+ *  @param[in] limit - the segment ends at the first number starting this many characters or more after c
+ *  @param[out] end - start of the token following the segment
+ *  @param[out] more - whether the run continues after the segment
+ *  @returns the number of numbers in the segment, or -1 if the index doesn't cover c or the numbers aren't separated */
+int structural_countsegment(structuralindex *s, const char *c, bool integers, size_t limit, const char **end, bool *more) {
+    size_t pos = (size_t) (c - s->start);
+    size_t lasttoken = pos;
+    int count = 0;
+    bool first = true;
+
+    *more=false;
+    if (pos<s->wstart) return -1;
+    size_t limitpos = (limit < s->length-pos ? pos+limit : s->length);
+
+    while (pos<s->length) {
+        if (pos>=s->wstart+STRUCTURAL_WINDOW) {
+            structural_nextwindow(s);
+            continue;
+        }
+
+        size_t rel = pos - s->wstart;
+        uint64_t mask = UINT64_MAX << (rel%64);
+
+        /* The first number must be marked as starting a token, or it wouldn't be counted */
+        if (first && !(s->tokens[rel/64] & (((uint64_t) 1) << (rel%64)))) return -1;
+        first=false;
+
+        for (size_t w=rel/64; w<STRUCTURAL_WORDS; w++, mask=UINT64_MAX) {
+            uint64_t tokens = s->tokens[w] & mask;
+            uint64_t stop = (s->other[w] | (integers ? s->fraction[w] : 0)) & mask;
+            size_t base = s->wstart + 64*w;
+            size_t segend = SIZE_MAX;
+
+            if (stop) {
+                int b = structural_lowestbit(stop);
+
+                if (s->other[w] & (((uint64_t) 1) << b)) { /* The run ends at a character that isn't part of a number */
+                    segend = base + b;
+                } else { /* The run ends at the start of the float containing this character */
+                    uint64_t upto = tokens & (UINT64_MAX >> (63-b));
+                    segend = (upto ? base + structural_highestbit(upto) : lasttoken);
+                }
+            }
+
+            /* The segment ends at the first number beyond the limit, unless the run ends first */
+            if (limitpos < base+64) {
+                uint64_t beyond = tokens & ~structural_below(limitpos>base ? limitpos-base : 0);
+                if (beyond && base + structural_lowestbit(beyond) < segend) {
+                    segend = base + structural_lowestbit(beyond);
+                    *more = true;
+                }
+            }
+
+            if (segend!=SIZE_MAX) {
+                uint64_t within = structural_below(segend>base ? segend-base : 0);
+                if (s->glued[w] & mask & within) return -1;
+
+                count += structural_popcount(tokens & within);
+                if (segend<base) count -= 1; /* The float started in an earlier word */
+
+                *end = s->start + segend;
+                return (count>0 ? count : 0);
+            }
+
+            if (s->glued[w] & mask) return -1;
+            count += structural_popcount(tokens);
+            if (tokens) lasttoken = base + structural_highestbit(tokens);
+        }
+
+        pos = s->wstart+STRUCTURAL_WINDOW;
+    }
+
+    *end = s->start+s->length;
+    return count;
+}
+
+/** Counts a run of numbers from the index
+ *  @param[in] s - the index
+ *  @param[in] c - start of the first number in the run
+ *  @param[in] integers - whether the run ends at the first float
+ *  @param[out] end - start of the token following the run
+ *  @returns the number of numbers in the run, or -1 if the index can't be used */
+int structural_countrun(structuralindex *s, const char *c, bool integers, const char **end) {
+    bool more;
+    return structural_countsegment(s, c, integers, SIZE_MAX, end, &more);
+}
@@ -0,0 +1,53 @@
+/** @file structural.h
+ *  @author T J Atherton
+ *
+ *  @brief Vectorized structural index for the command language lexer
+ */
+
+#ifndef structural_h
+#define structural_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Number of characters covered by a window of the index; must be a multiple of 64 */
+#define STRUCTURAL_WINDOW 16384
+#define STRUCTURAL_WORDS (STRUCTURAL_WINDOW/64)
+
+/** @brief A structural index over a window of the input.
+ *  @details Characters are classified 64 at a time, with one bit per character in each bitmap:
+ *  - tokens marks characters that may start a token, i.e. those following white space, outside of strings.
+ *  - other marks characters that can't be part of a run of numbers (command letters, quotes, the terminator),
+ *    including 'e' and 'E' where they start a token.
+ *  - fraction marks characters that only occur in floats ('.', and 'e' or 'E' within a number).
+ *  - glued marks signs that neither start a number nor its exponent, and so join two numbers without white space.
+ *  The window moves forward through the input as the lexer does, so memory use is independent of the input size. */
+typedef struct {
+    const char *start; /** Start of the input */
+    size_t length; /** Length of the input */
+
+    size_t wstart; /** Offset of the current window */
+    size_t wlength; /** Number of characters in the current window */
+
+    bool prevspace; /** Whether the character preceding the next window is white space */
+    bool prevexponent; /** Whether the character preceding the next window is an exponent marker */
+    bool instring; /** Whether the next window starts within a string */
+
+    uint64_t tokens[STRUCTURAL_WORDS];
+    uint64_t other[STRUCTURAL_WORDS];
+    uint64_t fraction[STRUCTURAL_WORDS];
+    uint64_t glued[STRUCTURAL_WORDS];
+} structuralindex;
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+void structural_init(structuralindex *s, const char *start, size_t length);
+
+const char *structural_skipspace(structuralindex *s, const char *c);
+int structural_countsegment(structuralindex *s, const char *c, bool integers, size_t limit, const char **end, bool *more);
+int structural_countrun(structuralindex *s, const char *c, bool integers, const char **end);
+
+#endif /* structural_h */
@@ -4,10 +4,14 @@
  *  @brief Text rendering using freetype
  */
 
+#include <string.h>
 #include "text.h"
 
 FT_Library ftlibrary;
 
+/** Faces opened so far */
+varray_textface textfaces;
+
 /* -------------------------------------------------------
  * UTF8 handling code
  * ------------------------------------------------------- */
@@ -242,8 +246,15 @@ bool text_skylineextend(textskyline *skyline, int height) {
  * Creating the texture
  * ------------------------------------------------------- */
 
+/** Clears the texture atlas */
+void text_cleartexture(textfont *font) {
+    if (font->texturedata) free(font->texturedata);
+    font->texturedata=NULL;
+}
+
 /** Allocates a texture of correct size */
 bool text_allocatetexture(textfont *font) {
+    text_cleartexture(font); /* The atlas is regenerated whenever the scene is prepared again */
     
     size_t size = font->skyline.width*font->skyline.height;
     font->texturedata=malloc(sizeof(char)*size);
@@ -273,16 +284,12 @@ bool text_generatetexture(textfont *font) {
     return true;
 }
 
-/** Clears the texture atlas */
-void text_cleartexture(textfont *font) {
-    if (font->texturedata) free(font->texturedata);
-}
-
 /* -------------------------------------------------------
  * Manage fonts
  * ------------------------------------------------------- */
 
 DEFINE_VARRAY(textglyph, textglyph);
+DEFINE_VARRAY(textface, textface);
 
 /** Initializes a font structure */
 void text_fontinit(textfont *font, int width) {
@@ -291,9 +298,8 @@ void text_fontinit(textfont *font, int width) {
     font->texturedata=NULL;
 }
 
-/** Clears a font structure */
+/** Clears a font structure; the face remains open in the cache */
 void text_fontclear(textfont *font) {
-    FT_Done_Face(font->face);
     
     text_skylineclear(&font->skyline);
     varray_textglyphclear(&font->glyphs);
@@ -307,12 +313,33 @@ void text_fontclear(textfont *font) {
  * @param[out] font - Font record filled out
  * @returns true on success */
 bool text_openfont(char *file, int size, textfont *font) {
-    FT_Error error = FT_New_Face(ftlibrary, file, 0, &font->face);
-    if (error) return false;
+    /* Reuse a face already opened at this size */
+    for (int i=0; i<textfaces.count; i++) {
+        textface *f = &textfaces.data[i];
+        if (f->size==size && strcmp(f->file, file)==0) {
+            font->face=f->face;
+            return true;
+        }
+    }
     
-    error = FT_Set_Pixel_Sizes(font->face, 0, size);
-    if (error) return false;
+    textface new = { .file = malloc(strlen(file)+1), .size = size };
+    if (!new.file) return false;
+    strcpy(new.file, file);
     
+    FT_Error error = FT_New_Face(ftlibrary, file, 0, &new.face);
+    if (error) {
+        free(new.file);
+        return false;
+    }
+    
+    error = FT_Set_Pixel_Sizes(new.face, 0, size);
+    if (error || !varray_textfaceadd(&textfaces, &new, 1)) {
+        FT_Done_Face(new.face);
+        free(new.file);
+        return false;
+    }
+    
+    font->face=new.face;
     return true;
 }
 
@@ -408,9 +435,16 @@ bool text_findglyph(textfont *font, char *string, textglyph *glyph, char **next)
 /* Initialize the text library */
 void text_initialize(void) {
     FT_Init_FreeType(&ftlibrary);
+    varray_textfaceinit(&textfaces);
 }
 
 void text_finalize(void) {
+    for (int i=0; i<textfaces.count; i++) {
+        FT_Done_Face(textfaces.data[i].face);
+        free(textfaces.data[i].file);
+    }
+    varray_textfaceclear(&textfaces);
+    
     FT_Done_FreeType(ftlibrary);
 }
 
@@ -10,13 +10,11 @@
 #include "varray.h"
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
-#define GL_SILENCE_DEPRECATION
-#include <glad/glad.h>
-
 #define TEXT_DEFAULTWIDTH 1280
 #define TEXT_DEFAULTHEIGHT 960
 #define TEXTSKYLINE_EMPTY -1
@@ -50,8 +48,17 @@ typedef struct {
 
 DECLARE_VARRAY(textglyph, textglyph);
 
+/** Font faces opened by FreeType; these are kept open for reuse until text_finalize */
 typedef struct {
+    char *file;
+    int size; /** Size in pixels */
     FT_Face face;
+} textface;
+
+DECLARE_VARRAY(textface, textface);
+
+typedef struct {
+    FT_Face face; /** Face from the cache of open faces */
     
     textskyline skyline;
     varray_textglyph glyphs;
@@ -0,0 +1,174 @@
+/** @file viewer.c
+ *  @author T J Atherton
+ *
+ *  @brief Displays scenes built within another program, such as morpho, on a thread of their own
+ *  @details Scenes are handed over through a queue. The viewer thread makes every GLFW call, from initialization
+ *           to termination, and owns every window, so the program that builds the scenes carries on while they are
+ *           displayed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "viewer.h"
+#include "display.h"
+
+#ifdef VIEWER_THREAD
+#include <pthread.h>
+#endif
+
+/** @brief A scene waiting to be displayed */
+typedef struct {
+    scene *s;
+    char *title; /** Window title, or NULL */
+} viewerscene;
+
+DECLARE_VARRAY(viewerscene, viewerscene);
+DEFINE_VARRAY(viewerscene, viewerscene);
+
+/** Scenes waiting to be displayed */
+static varray_viewerscene pending;
+
+/** Whether GLFW has been initialized by the viewer */
+static bool viewerdisplayinitialized = false;
+
+#ifdef VIEWER_THREAD
+static pthread_t viewerthread;
+static bool viewerstarted = false;
+static bool viewerquit = false;
+
+/** Whether any windows are open or scenes are waiting to be displayed */
+static bool viewerbusy = false;
+
+/** Protects the queue and the state above */
+static pthread_mutex_t viewerlock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Signalled when scenes are queued, the viewer becomes idle or is asked to quit */
+static pthread_cond_t viewerchanged = PTHREAD_COND_INITIALIZER;
+#endif
+
+/* -------------------------------------------------------
+ * Windows
+ * ------------------------------------------------------- */
+
+/** Opens a window for each of a list of scenes, which are then owned by the windows */
+static void viewer_open(varray_viewerscene *list) {
+    if (!viewerdisplayinitialized) viewerdisplayinitialized=display_initialize();
+    
+    for (unsigned int i=0; i<list->count; i++) {
+        viewerscene *v = &list->data[i];
+        display *d = (viewerdisplayinitialized ? display_open(v->s) : NULL);
+        
+        if (d) {
+            if (v->title) display_setwindowtitle(d, v->title);
+            display_refresh(d);
+        } else scene_free(v->s);
+        
+        free(v->title);
+    }
+    list->count=0;
+}
+
+#ifdef VIEWER_THREAD
+/** Runs windows until asked to quit, sleeping while none are open */
+static void *viewer_thread(void *ref) {
+    varray_viewerscene opening;
+    varray_viewersceneinit(&opening);
+    bool open=false;
+    
+    for (;;) {
+        pthread_mutex_lock(&viewerlock);
+        while (!open && pending.count==0 && !viewerquit) {
+            viewerbusy=false;
+            pthread_cond_broadcast(&viewerchanged);
+            pthread_cond_wait(&viewerchanged, &viewerlock);
+        }
+        
+        if (viewerquit) {
+            pthread_mutex_unlock(&viewerlock);
+            break;
+        }
+        
+        /* Take the queued scenes, so that windows are opened without holding the lock */
+        varray_viewerscene swap = opening;
+        opening=pending;
+        pending=swap;
+        pthread_mutex_unlock(&viewerlock);
+        
+        viewer_open(&opening);
+        open=display_wait(VIEWER_POLLINTERVAL);
+    }
+    
+    varray_viewersceneclear(&opening);
+    if (viewerdisplayinitialized) display_finalize();
+    viewerdisplayinitialized=false;
+    return NULL;
+}
+#endif
+
+/* -------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------- */
+
+/** Displays a scene in a new window
+ *  @param[in] s - the scene, which is then owned by the viewer
+ *  @param[in] title - window title, or NULL */
+void viewer_show(scene *s, const char *title) {
+    viewerscene v = { .s = s, .title = NULL };
+    if (title) {
+        v.title=malloc(strlen(title)+1);
+        if (v.title) strcpy(v.title, title);
+    }
+
+#ifdef VIEWER_THREAD
+    pthread_mutex_lock(&viewerlock);
+    varray_viewerscenewrite(&pending, v);
+    viewerbusy=true;
+    if (!viewerstarted) viewerstarted=(pthread_create(&viewerthread, NULL, viewer_thread, NULL)==0);
+    pthread_cond_broadcast(&viewerchanged);
+    pthread_mutex_unlock(&viewerlock);
+    
+    if (!viewerstarted) fprintf(stderr, "morphoview: Couldn't start viewer thread.\n");
+#else
+    varray_viewerscenewrite(&pending, v);
+#endif
+}
+
+/** Waits until every window has been closed */
+void viewer_wait(void) {
+#ifdef VIEWER_THREAD
+    pthread_mutex_lock(&viewerlock);
+    while (viewerstarted && viewerbusy) pthread_cond_wait(&viewerchanged, &viewerlock);
+    pthread_mutex_unlock(&viewerlock);
+#else
+    /* Windows run on the calling thread */
+    viewer_open(&pending);
+    while (display_wait(DISPLAY_WAITFOREVER)) viewer_open(&pending);
+#endif
+}
+
+void viewer_initialize(void) {
+    varray_viewersceneinit(&pending);
+}
+
+/** Waits for any open windows to be closed and shuts down the viewer */
+void viewer_finalize(void) {
+    viewer_wait();
+
+#ifdef VIEWER_THREAD
+    if (viewerstarted) {
+        pthread_mutex_lock(&viewerlock);
+        viewerquit=true;
+        pthread_cond_broadcast(&viewerchanged);
+        pthread_mutex_unlock(&viewerlock);
+        
+        pthread_join(viewerthread, NULL);
+        viewerstarted=false;
+    }
+#else
+    if (viewerdisplayinitialized) display_finalize();
+    viewerdisplayinitialized=false;
+#endif
+    
+    varray_viewersceneclear(&pending);
+}
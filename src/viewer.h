@@ -0,0 +1,32 @@
+/** @file viewer.h
+ *  @author T J Atherton
+ *
+ *  @brief Displays scenes built within another program, such as morpho, on a thread of their own
+ */
+
+#ifndef viewer_h
+#define viewer_h
+
+#include <stdbool.h>
+#include "scene.h"
+
+/** Run windows on a thread of their own where the platform allows; macOS requires them to belong to the main
+ *  thread, so there they are run when the program waits for them */
+#if !defined(__APPLE__) && !defined(_WIN32)
+#define VIEWER_THREAD
+#endif
+
+/** Interval in seconds between checks for new scenes while windows are open on the viewer's thread */
+#define VIEWER_POLLINTERVAL 0.05
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+void viewer_show(scene *s, const char *title);
+void viewer_wait(void);
+
+void viewer_initialize(void);
+void viewer_finalize(void);
+
+#endif /* viewer_h */
@@ -0,0 +1,254 @@
+/** @file watch.c
+ *  @author T J Atherton
+ *
+ *  @brief Displays a command file, reloading it whenever it changes
+ *  @details The file is parsed again each time it is rewritten, and each scene replaces the scene with the same id in
+ *           its existing window. The window keeps its view, and only vertex and element data that has changed is
+ *           uploaded to the GPU again. If the new file can't be parsed, e.g. as it is still being written, the
+ *           scenes already shown are kept.
+ *
+ *           The directory holding the file is watched, rather than the file itself, so that files replaced by
+ *           renaming another over them are followed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "watch.h"
+#include "command.h"
+#include "cache.h"
+#include "display.h"
+#include "varray.h"
+
+#ifdef WATCH_INOTIFY
+#include <limits.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+/* -------------------------------------------------------
+ * Scene sink
+ * ------------------------------------------------------- */
+
+/** @brief A scene read from the file, held until the whole file has been parsed */
+typedef struct {
+    scene *s;
+    char *title; /** Window title, or NULL */
+} watchscene;
+
+DECLARE_VARRAY(watchscene, watchscene);
+DEFINE_VARRAY(watchscene, watchscene);
+
+/** Scenes read from the file so far */
+static varray_watchscene watchscenes;
+
+/** Holds each scene until parsing is complete; the handle is the scene's position in the list, counting from 1 */
+static void *watch_sinkopen(void *ref, scene *s) {
+    watchscene w = { .s = s, .title = NULL };
+    varray_watchscenewrite(&watchscenes, w);
+    return (void *) (intptr_t) watchscenes.count;
+}
+
+static void watch_sinksettitle(void *ref, void *handle, char *title) {
+    intptr_t i = (intptr_t) handle;
+    if (i<1 || i>watchscenes.count) return;
+    
+    watchscene *w = &watchscenes.data[i-1];
+    free(w->title);
+    w->title=malloc(strlen(title)+1);
+    if (w->title) strcpy(w->title, title);
+}
+
+/** Receives scenes as the file is parsed */
+static scenesink watchsink = { .open = watch_sinkopen, .settitle = watch_sinksettitle };
+
+/** Shows the scenes read from the file, replacing the scenes in windows already showing the same ids */
+static void watch_show(void) {
+    for (unsigned int i=0; i<watchscenes.count; i++) {
+        watchscene *w = &watchscenes.data[i];
+        display *d = display_findscene(w->s->id);
+        
+        if (d) {
+            display_updatescene(d, w->s);
+        } else if ((d=display_open(w->s))) {
+            display_refresh(d);
+        } else {
+            scene_free(w->s);
+        }
+        
+        if (d && w->title) display_setwindowtitle(d, w->title);
+        free(w->title);
+    }
+    watchscenes.count=0;
+}
+
+/** Discards the scenes read from the file */
+static void watch_discard(void) {
+    for (unsigned int i=0; i<watchscenes.count; i++) {
+        scene_free(watchscenes.data[i].s);
+        free(watchscenes.data[i].title);
+    }
+    watchscenes.count=0;
+}
+
+/** Parses the file and shows its scenes
+ *  @returns true on success */
+static bool watch_load(const char *file, bool cache) {
+    commandinput input;
+    
+    /* The file isn't mapped, as it may be rewritten while it is parsed */
+    bool success=command_readfile(file, &input);
+    if (success) {
+        success=(cache ? cache_parseinput(&input, &watchsink) : command_parseinput(&input, &watchsink));
+        command_freeinput(&input);
+    }
+    
+    if (success) watch_show();
+    else watch_discard();
+    
+    return success;
+}
+
+/* -------------------------------------------------------
+ * Detect changes
+ * ------------------------------------------------------- */
+
+/** @brief Identifies a version of the file when polling */
+typedef struct {
+    bool exists;
+    time_t mtime;
+    off_t size;
+} watchstamp;
+
+/** @brief Watches a file for changes */
+typedef struct {
+    const char *file;
+    watchstamp loaded; /** Version of the file last loaded */
+    watchstamp seen; /** Version of the file seen at the last check */
+    double next; /** Time of the next check */
+    int fd; /** inotify instance, or -1 if the file is polled */
+    const char *name; /** Name of the file within its directory */
+} watcher;
+
+/** Finds the current version of the file */
+static watchstamp watch_stamp(const char *file) {
+    struct stat st;
+    watchstamp stamp = { .exists = (stat(file, &st)==0) };
+    if (stamp.exists) {
+        stamp.mtime=st.st_mtime;
+        stamp.size=st.st_size;
+    }
+    return stamp;
+}
+
+/** Compares two versions of the file */
+static bool watch_samestamp(watchstamp *a, watchstamp *b) {
+    return (a->exists==b->exists && a->mtime==b->mtime && a->size==b->size);
+}
+
+/** Begins watching a file */
+static void watch_init(watcher *w, const char *file) {
+    w->file=file;
+    w->loaded=watch_stamp(file);
+    w->seen=w->loaded;
+    w->next=glfwGetTime()+WATCH_POLLINTERVAL;
+    w->fd=-1;
+    
+    const char *slash = strrchr(file, '/');
+    w->name=(slash ? slash+1 : file);
+
+#ifdef WATCH_INOTIFY
+    char dir[PATH_MAX];
+    size_t length = (slash ? (size_t) (slash-file) : 0);
+    if (length>=sizeof(dir)) return;
+    
+    if (!slash) strcpy(dir, ".");
+    else if (length==0) strcpy(dir, "/");
+    else {
+        memcpy(dir, file, length);
+        dir[length]='\0';
+    }
+    
+    w->fd=inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd>=0 && inotify_add_watch(w->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO)<0) {
+        close(w->fd);
+        w->fd=-1;
+    }
+    if (w->fd<0) fprintf(stderr, "morphoview: Couldn't watch %s for changes; polling instead.\n", dir);
+#endif
+}
+
+/** Stops watching a file */
+static void watch_clear(watcher *w) {
+#ifdef WATCH_INOTIFY
+    if (w->fd>=0) close(w->fd);
+    w->fd=-1;
+#endif
+}
+
+/** Checks whether the file has been rewritten since it was last loaded */
+static bool watch_changed(watcher *w) {
+#ifdef WATCH_INOTIFY
+    if (w->fd>=0) {
+        char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        bool changed=false;
+        ssize_t n;
+        
+        while ((n=read(w->fd, buffer, sizeof(buffer)))>0) {
+            for (char *p=buffer; p<buffer+n; ) {
+                struct inotify_event *event = (struct inotify_event *) p;
+                if (event->len>0 && strcmp(event->name, w->name)==0) changed=true;
+                p+=sizeof(struct inotify_event)+event->len;
+            }
+        }
+        return changed;
+    }
+#endif
+    
+    double t = glfwGetTime();
+    if (t<w->next) return false;
+    w->next=t+WATCH_POLLINTERVAL;
+    
+    /* Wait for the file to stay the same for an interval, so that it isn't read while still being written */
+    watchstamp stamp = watch_stamp(w->file);
+    bool settled = watch_samestamp(&stamp, &w->seen);
+    w->seen=stamp;
+    
+    if (!settled || !stamp.exists || watch_samestamp(&stamp, &w->loaded)) return false;
+    w->loaded=stamp;
+    return true;
+}
+
+/* -------------------------------------------------------
+ * Watch loop
+ * ------------------------------------------------------- */
+
+/** Displays a file, reloading it whenever it changes, until every window has been closed
+ *  @param[in] file - the command file
+ *  @param[in] cache - whether to reuse scenes cached from an earlier run; only the first load uses the cache, as
+ *                     each rewrite of the file would otherwise add another entry to it
+ *  @returns true on success */
+bool watch_run(const char *file, bool cache) {
+    varray_watchsceneinit(&watchscenes);
+    
+    watcher w;
+    watch_init(&w, file);
+    
+    bool success=watch_load(file, cache);
+    
+    if (success) {
+        while (display_wait(WATCH_POLLINTERVAL)) {
+            if (watch_changed(&w) && !watch_load(file, false)) {
+                fprintf(stderr, "morphoview: Couldn't reload %s; keeping the scenes shown.\n", file);
+            }
+        }
+    }
+    
+    watch_clear(&w);
+    varray_watchsceneclear(&watchscenes);
+    
+    return success;
+}
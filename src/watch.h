@@ -0,0 +1,26 @@
+/** @file watch.h
+ *  @author T J Atherton
+ *
+ *  @brief Displays a command file, reloading it whenever it changes
+ */
+
+#ifndef watch_h
+#define watch_h
+
+#include <stdbool.h>
+
+/** Use inotify to learn of changes where available; elsewhere the file is polled */
+#ifdef __linux__
+#define WATCH_INOTIFY
+#endif
+
+/** Interval in seconds between checks of the file when polling */
+#define WATCH_POLLINTERVAL 0.25
+
+/* -------------------------------------------------------
+ * Prototypes
+ * ------------------------------------------------------- */
+
+bool watch_run(const char *file, bool cache);
+
+#endif /* watch_h */
@@ -0,0 +1,289 @@
+/** @file numerictest.c
+ *  @author T J Atherton
+ *
+ *  @brief Checks the numeric module against the C library
+ *  @details Every float is converted both by numeric_parsefloat and by strtof in the C locale, and the results must
+ *           agree bit for bit. Cases cover random values printed at several precisions, values exactly halfway
+ *           between two floats and just either side, subnormals, overflow and underflow, and tokens with more
+ *           significant digits than fit in 64 bits. The slow path, which substitutes the locale's decimal point, is
+ *           checked again under a locale that uses a comma, where one is installed.
+ *
+ *  Usage: morphoview-numerictest [count]
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <locale.h>
+#include <math.h>
+
+#include "numeric.h"
+
+/** Number of random values tried in each group by default */
+#define NUMERICTEST_COUNT 200000
+
+/** Number of failures reported before the rest are only counted */
+#define NUMERICTEST_MAXREPORTS 20
+
+static int nchecks = 0;
+static int nfailures = 0;
+
+/** Generates pseudo random numbers reproducibly */
+static uint64_t numerictest_random(void) {
+    static uint64_t state = 0x9e3779b97f4a7c15;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+/** Records a failure */
+static void numerictest_fail(const char *format, ...) {
+    if (nfailures++<NUMERICTEST_MAXREPORTS) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+    }
+}
+
+/* -------------------------------------------------------
+ * Checks
+ * ------------------------------------------------------- */
+
+/** Bits of a float */
+static uint32_t numerictest_bits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+/** Checks a float token against strtof, which must be called in the C locale
+ *  @param[in] str - the token
+ *  @param[in] expected - result of strtof, or NULL to call it here */
+static void numerictest_checkfloat(const char *str, float *expected) {
+    float f, g = (expected ? *expected : strtof(str, NULL));
+    nchecks++;
+
+    if (!numeric_parsefloat(str, (unsigned int) strlen(str), &f)) {
+        numerictest_fail("Float '%s' not accepted, expected %08x.\n", str, numerictest_bits(g));
+    } else if (numerictest_bits(f)!=numerictest_bits(g)) {
+        numerictest_fail("Float '%s' converted to %08x, expected %08x.\n", str, numerictest_bits(f), numerictest_bits(g));
+    }
+}
+
+/** Checks a float, and its negation, printed with a given format */
+static void numerictest_checkprinted(const char *format, double value) {
+    char str[512];
+    snprintf(str, sizeof(str), format, value);
+    numerictest_checkfloat(str, NULL);
+    snprintf(str, sizeof(str), format, -value);
+    numerictest_checkfloat(str, NULL);
+}
+
+/** Checks a token that must be rejected as a whole */
+static void numerictest_checkrejected(const char *str) {
+    float f;
+    int i;
+    nchecks++;
+
+    if (numeric_parsefloat(str, (unsigned int) strlen(str), &f)) numerictest_fail("Float '%s' accepted.\n", str);
+    if (numeric_parseinteger(str, (unsigned int) strlen(str), &i)) numerictest_fail("Integer '%s' accepted.\n", str);
+}
+
+/** Checks an integer token against strtol */
+static void numerictest_checkinteger(const char *str) {
+    int i;
+    long expected = strtol(str, NULL, 10);
+    nchecks++;
+
+    if (!numeric_parseinteger(str, (unsigned int) strlen(str), &i)) {
+        numerictest_fail("Integer '%s' not accepted.\n", str);
+    } else if (i!=(int) expected) {
+        numerictest_fail("Integer '%s' converted to %i, expected %li.\n", str, i, expected);
+    }
+}
+
+/* -------------------------------------------------------
+ * Groups of cases
+ * ------------------------------------------------------- */
+
+/** Tokens chosen by hand around the edges of the fast paths */
+static const char *numerictest_fixed[] = {
+    "0", "-0", "0.0", "00000.00000", "1", "-1", "0.5", ".5", "-.5", "5.", "1e5", "1E5", "1e+5", "1e-5", "-1.5e-3",
+    "0.1", "0.2", "0.3", "3.14159265358979323846", "16777216", "16777217", "16777218", "16777219",
+    "9999999999", "10000000000", "1e10", "1e11", "1e-10", "1e-11", "0.0000001",
+
+    /* Overflow and the largest floats */
+    "3.4028234e38", "3.40282347e38", "3.4028235e38", "3.40282356e38", "3.40282357e38", "3.4028236e38",
+    "1e38", "1e39", "-1e39", "1e400", "1e99999", "123456789e30", "0.000001e45",
+
+    /* Underflow, subnormals and the smallest floats */
+    "1.17549435e-38", "1.1754942e-38", "1e-38", "1e-40", "1e-44", "1.4e-45", "1.401298464e-45", "1e-45",
+    "7.006492321624085e-46", "7.006492321624086e-46", "7.0064923e-46", "7e-46", "1e-46", "1e-50", "1e-400",
+    "2.350988701644575e-38", "2.3509887e-38",
+
+    /* More significant digits than fit in 64 bits */
+    "12345678901234567890", "123456789012345678901", "1234567890123456789012345678901234567890",
+    "1.00000000000000000000000000001", "0.99999999999999999999999999999",
+    "0.000000000000000000000000000001234567890123456789012",
+    "16777217.0000000000000000000000001", "16777216.9999999999999999999999999",
+    "3.40282356779733661637539395458142568448e38", "3.40282356779733661637539395458142568447e38",
+    "1.40129846432481707092372958328991613128e-45", "7.00649232162408535461864791644958065640e-46",
+    "7.00649232162408535461864791644958065641e-46",
+    "0.000000000000000000000000000000000000000000000700649232162408535461864791644958065641",
+    NULL
+};
+
+/** Random floats printed at several precisions */
+static void numerictest_random_floats(int count) {
+    for (int i=0; i<count; i++) {
+        uint32_t bits = (uint32_t) numerictest_random() & 0x7fffffff;
+        if ((bits>>23)==0xff) continue; /* Infinity and NaN */
+
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+
+        numerictest_checkprinted("%.9g", f);
+        numerictest_checkprinted("%.6g", f);
+        numerictest_checkprinted("%.17g", f);
+        numerictest_checkprinted("%.25e", f);
+    }
+}
+
+/** Values exactly halfway between adjacent floats, and just either side of halfway */
+static void numerictest_halfway(int count) {
+    for (int i=0; i<count; i++) {
+        uint32_t bits = (uint32_t) numerictest_random() & 0x7fffffff;
+        if ((bits>>23)>=0xfe) continue;
+
+        float lo, hi;
+        memcpy(&lo, &bits, sizeof(lo));
+        bits++;
+        memcpy(&hi, &bits, sizeof(hi));
+
+        /* The midpoint of two floats is exact in double precision, and printed exactly */
+        char str[1024];
+        double mid = ((double) lo + (double) hi)/2;
+        snprintf(str, sizeof(str), "%.*e", 120, mid);
+        numerictest_checkfloat(str, NULL);
+
+        /* Nudge the last digit of the exact expansion, keeping the exponent */
+        char *e = strchr(str, 'e');
+        if (!e) continue;
+        char exponent[16];
+        snprintf(exponent, sizeof(exponent), "%s", e);
+
+        char above[1100];
+        snprintf(above, sizeof(above), "%.*s1%s", (int) (e-str), str, exponent);
+        numerictest_checkfloat(above, NULL);
+
+        snprintf(str, sizeof(str), "%.*e", 120, nextafter(mid, 0.0));
+        numerictest_checkfloat(str, NULL);
+        snprintf(str, sizeof(str), "%.*e", 120, nextafter(mid, 1e300));
+        numerictest_checkfloat(str, NULL);
+    }
+}
+
+/** Subnormal floats, and values near the smallest */
+static void numerictest_subnormals(int count) {
+    for (int i=0; i<count; i++) {
+        uint32_t bits = (uint32_t) numerictest_random() & 0x007fffff;
+
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+
+        numerictest_checkprinted("%.9g", f);
+        numerictest_checkprinted("%.3g", f);
+        numerictest_checkprinted("%.30e", f);
+    }
+}
+
+/** Random strings of 1 to 26 digits with a decimal point and a decimal exponent */
+static void numerictest_longdigits(int count) {
+    for (int i=0; i<count; i++) {
+        char str[64];
+        int ndigits = 1 + (int) (numerictest_random()%26);
+        int point = (int) (numerictest_random()%(ndigits+1));
+        char *c = str;
+
+        for (int k=0; k<ndigits; k++) {
+            if (k==point) *c++='.';
+            *c++=(char) ('0' + numerictest_random()%10);
+        }
+        sprintf(c, "e%i", (int) (numerictest_random()%90)-45);
+
+        numerictest_checkfloat(str, NULL);
+    }
+}
+
+/** Integers across the range of int */
+static void numerictest_integers(int count) {
+    const char *fixed[] = { "0", "-0", "1", "-1", "007", "2147483647", "-2147483648", "-2147483647", NULL };
+    for (int i=0; fixed[i]; i++) numerictest_checkinteger(fixed[i]);
+
+    for (int i=0; i<count; i++) {
+        char str[32];
+        long value = (long) (numerictest_random()%((uint64_t) INT_MAX+1));
+        for (int k=(int) (numerictest_random()%10); k>0; k--) value/=10; /* Vary the number of digits */
+        snprintf(str, sizeof(str), "%s%ld", (numerictest_random()&1 ? "-" : ""), value);
+        numerictest_checkinteger(str);
+    }
+}
+
+/** Tokens that aren't numbers as a whole */
+static void numerictest_rejected(void) {
+    const char *tokens[] = { "1a", "12x", "1.5.2", "1e5x", "--1", "1-", "0x10", NULL };
+    for (int i=0; tokens[i]; i++) numerictest_checkrejected(tokens[i]);
+
+    int i;
+    nchecks++;
+    if (numeric_parseinteger("1.5", 3, &i)) numerictest_fail("Integer '%s' accepted.\n", "1.5");
+}
+
+/** Checks the fixed tokens again under a locale with a decimal comma, against their results in the C locale */
+static void numerictest_locale(void) {
+    int n = 0;
+    while (numerictest_fixed[n]) n++;
+
+    float *expected = malloc(sizeof(float)*n);
+    if (!expected) return;
+    for (int i=0; i<n; i++) expected[i]=strtof(numerictest_fixed[i], NULL);
+
+    const char *locales[] = { "de_DE.UTF-8", "de_DE", "fr_FR.UTF-8", "fr_FR", NULL };
+    for (int k=0; locales[k]; k++) {
+        if (setlocale(LC_NUMERIC, locales[k]) && localeconv()->decimal_point[0]==',') {
+            for (int i=0; i<n; i++) numerictest_checkfloat(numerictest_fixed[i], &expected[i]);
+            printf("Checked under locale %s.\n", locales[k]);
+            break;
+        }
+    }
+
+    setlocale(LC_NUMERIC, "C");
+    free(expected);
+}
+
+/* -------------------------------------------------------
+ * Run the tests
+ * ------------------------------------------------------- */
+
+int main(int argc, const char *argv[]) {
+    int count = (argc>1 ? atoi(argv[1]) : NUMERICTEST_COUNT);
+    setlocale(LC_ALL, "C");
+
+    for (int i=0; numerictest_fixed[i]; i++) numerictest_checkfloat(numerictest_fixed[i], NULL);
+    numerictest_random_floats(count);
+    numerictest_halfway(count);
+    numerictest_subnormals(count/4);
+    numerictest_longdigits(count);
+    numerictest_integers(count);
+    numerictest_rejected();
+    numerictest_locale();
+
+    printf("%i checks, %i failures.\n", nchecks, nfailures);
+    return (nfailures ? 1 : 0);
+}
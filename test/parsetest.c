@@ -0,0 +1,214 @@
+/** @file parsetest.c
+ *  @author T J Atherton
+ *
+ *  @brief Checks that runs of numbers converted on worker threads match those converted as they're parsed
+ *  @details Each input is generated with runs long enough to be deferred to worker threads, parsed with one thread
+ *           and again with several, and the vertex, index and color arrays of the resulting scenes compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "varray.h"
+#include "scene.h"
+#include "command.h"
+
+/** Number of threads compared against a single thread */
+#define PARSETEST_THREADS 8
+
+/** Number of values in each generated run, enough that the run is longer than COMMAND_JOBMIN */
+#define PARSETEST_RUN 30000
+
+/* -------------------------------------------------------
+ * Scene sink
+ * ------------------------------------------------------- */
+
+DECLARE_VARRAY(scene, scene *);
+DEFINE_VARRAY(scene, scene *);
+
+/** Scenes created by the most recent parse */
+static varray_scene scenes;
+
+/** Collects scenes in place of opening a window for them */
+static void *parsetest_sinkopen(void *ref, scene *s) {
+    varray_scenewrite(&scenes, s);
+    return NULL;
+}
+
+/** Receives scenes from the parser */
+static scenesink sink = { .open = parsetest_sinkopen };
+
+/** Frees scenes collected by the sink */
+static void parsetest_freescenes(void) {
+    for (unsigned int i=0; i<scenes.count; i++) scene_free(scenes.data[i]);
+    scenes.count=0;
+}
+
+/* -------------------------------------------------------
+ * Inputs
+ * ------------------------------------------------------- */
+
+/** Appends a run of numbers to an input
+ *  @param[in] in - the input
+ *  @param[in] prefix - text written before the first number, including any space between them
+ *  @param[in] n - number of values
+ *  @param[in] integers - whether to write integers or floats */
+static void parsetest_run(varray_char *in, const char *prefix, int n, bool integers) {
+    char str[32];
+    varray_charadd(in, (char *) prefix, (int) strlen(prefix));
+    for (int i=0; i<n; i++) {
+        int len = (integers ? snprintf(str, sizeof(str), "%i ", i/3 + i%3) : snprintf(str, sizeof(str), "%g ", 0.26f + (float) (i%97)/64));
+        varray_charadd(in, str, len);
+    }
+    varray_charadd(in, "\n", 1);
+}
+
+/** Appends text to an input */
+static void parsetest_text(varray_char *in, const char *text) {
+    varray_charadd(in, (char *) text, (int) strlen(text));
+}
+
+/** Generates an input defining an object
+ *  @param[in] vertices - text preceding the vertex data
+ *  @param[in] after - commands following the vertex data
+ *  @param[in] elements - text preceding the facets
+ *  @param[in] colors - whether to define a color first */
+static char *parsetest_generate(const char *vertices, const char *after, const char *elements, bool colors) {
+    varray_char in;
+    varray_charinit(&in);
+
+    parsetest_text(&in, "S 1 3\n");
+    if (colors) parsetest_run(&in, "c 1 ", 3*PARSETEST_RUN, false);
+    parsetest_text(&in, "o 1\n");
+    parsetest_run(&in, vertices, 3*PARSETEST_RUN, false);
+    parsetest_text(&in, after);
+    parsetest_run(&in, elements, 3*(PARSETEST_RUN-2), true);
+    parsetest_text(&in, "d 1\n");
+    varray_charadd(&in, "", 1);
+
+    return in.data;
+}
+
+/** Generates an input that edits an object in place, with each command following a long run */
+static char *parsetest_generateedits(void) {
+    varray_char in;
+    varray_charinit(&in);
+
+    parsetest_text(&in, "S 1 3\no 1\n");
+    parsetest_run(&in, "v \"xyz\" ", 3*PARSETEST_RUN, false);
+    parsetest_run(&in, "f ", 3*(PARSETEST_RUN-2), true);
+    parsetest_text(&in, "d 1\n");
+    parsetest_run(&in, "R 1 ", 3*PARSETEST_RUN, false);
+    parsetest_run(&in, "A 1 \"x\" ", 3*PARSETEST_RUN, false);
+    parsetest_text(&in, "t 1 0 0\nU 1\no 2\n");
+    parsetest_run(&in, "v \"xyz\" ", 3*PARSETEST_RUN, false);
+    parsetest_text(&in, "D 1\n");
+    varray_charadd(&in, "", 1);
+
+    return in.data;
+}
+
+/* -------------------------------------------------------
+ * Comparison
+ * ------------------------------------------------------- */
+
+/** Copy of the arrays of a parsed scene */
+typedef struct {
+    varray_float data;
+    varray_int indx;
+    varray_float colors;
+} parsetestresult;
+
+/** Parses an input with a given number of threads, copying the arrays of the scene it defines */
+static bool parsetest_parse(const char *input, int threads, parsetestresult *r) {
+    varray_floatinit(&r->data);
+    varray_intinit(&r->indx);
+    varray_floatinit(&r->colors);
+
+    char *in = strdup(input);
+    if (!in) return false;
+
+    command_setthreads(threads);
+    bool success = command_parse(in, &sink);
+    free(in);
+
+    if (success && scenes.count==1) {
+        scene *s = scenes.data[0];
+        varray_floatadd(&r->data, s->data.data, s->data.count);
+        varray_intadd(&r->indx, s->indx.data, s->indx.count);
+        varray_floatadd(&r->colors, s->colors.data, s->colors.count);
+    } else success=false;
+
+    parsetest_freescenes();
+    return success;
+}
+
+/** Frees a copy of a scene's arrays */
+static void parsetest_clear(parsetestresult *r) {
+    varray_floatclear(&r->data);
+    varray_intclear(&r->indx);
+    varray_floatclear(&r->colors);
+}
+
+/** Compares two arrays, either of which may be empty */
+static bool parsetest_same(const void *a, unsigned int acount, const void *b, unsigned int bcount, size_t size) {
+    return (acount==bcount && (acount==0 || memcmp(a, b, size*acount)==0));
+}
+
+/** Checks that an input parses with one thread and several to the same arrays */
+static bool parsetest_check(const char *name, char *input) {
+    parsetestresult single, threaded;
+    bool success = false;
+
+    if (!parsetest_parse(input, 1, &single)) {
+        fprintf(stderr, "%s: Failed to parse with one thread.\n", name);
+    } else if (!parsetest_parse(input, PARSETEST_THREADS, &threaded)) {
+        fprintf(stderr, "%s: Failed to parse with %i threads.\n", name, PARSETEST_THREADS);
+        parsetest_clear(&threaded);
+    } else {
+        success = (parsetest_same(single.data.data, single.data.count, threaded.data.data, threaded.data.count, sizeof(float)) &&
+                   parsetest_same(single.indx.data, single.indx.count, threaded.indx.data, threaded.indx.count, sizeof(int)) &&
+                   parsetest_same(single.colors.data, single.colors.count, threaded.colors.data, threaded.colors.count, sizeof(float)));
+        if (!success) fprintf(stderr, "%s: Scenes parsed with one thread and %i threads differ.\n", name, PARSETEST_THREADS);
+        parsetest_clear(&threaded);
+    }
+
+    parsetest_clear(&single);
+    free(input);
+    if (success) printf("%s: ok\n", name);
+    return success;
+}
+
+/* -------------------------------------------------------
+ * Run the tests
+ * ------------------------------------------------------- */
+
+int main(void) {
+    bool success = true;
+
+    scene_initialize();
+    varray_sceneinit(&scenes);
+
+    success &= parsetest_check("separated", parsetest_generate("v \"xyz\" ", "", "f ", false));
+
+    /* The first number of a run follows the preceding token without white space */
+    success &= parsetest_check("joined", parsetest_generate("v \"xyz\"", "", "f", false));
+
+    /* Colors are converted before they're moved out of the data array */
+    success &= parsetest_check("colors", parsetest_generate("v \"xyz\" ", "", "f ", true));
+
+    /* The erase command's letter is also an exponent marker, but ends a run */
+    success &= parsetest_check("erase", parsetest_generate("v \"xyz\" ", "E 1\n", "f ", false));
+    success &= parsetest_check("erase joined", parsetest_generate("v \"xyz\"", "E 1\n", "f", false));
+    success &= parsetest_check("erase before draw", parsetest_generate("v \"xyz\" ", "E 1\nd 1\n", "f ", false));
+
+    /* Commands that edit objects in place */
+    success &= parsetest_check("edits", parsetest_generateedits());
+
+    varray_sceneclear(&scenes);
+    scene_finalize();
+
+    return (success ? 0 : 1);
+}
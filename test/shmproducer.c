@@ -0,0 +1,199 @@
+/** @file shmproducer.c
+ *  @author T J Atherton
+ *
+ *  @brief Test producer for the shared memory transport
+ *  @details Writes the vertices and facets of a torus into a segment of shared memory and sends the viewer a short
+ *           command file that refers to them with the M command, as morpho would. The commands are written to
+ *           standard output, for use with a pipe, or sent to a viewer started with --server. A server closes the
+ *           connection once it has parsed the commands, after which the segment is removed; otherwise the segment is
+ *           kept until the producer is interrupted, as the viewer must see the end of its input before it is done.
+ *
+ *  Usage: morphoview-shmproducer [-n resolution] [-s socket]
+ *         e.g. morphoview-shmproducer -n 2000 | morphoview -
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/** Default number of vertices around each circle of the torus */
+#define PRODUCER_RESOLUTION 256
+
+/** Number of floats per vertex, for the format "xnc" */
+#define PRODUCER_ENTRYSIZE 9
+
+/* -------------------------------------------------------
+ * Mesh
+ * ------------------------------------------------------- */
+
+/** Fills out the vertices, normals and colors of a torus with n x n vertices */
+static void producer_vertices(float *v, int n) {
+    const double pi = 3.14159265358979323846;
+    const double R = 1.0, r = 0.4;
+    
+    for (int i=0; i<n; i++) {
+        double u = 2*pi*i/n;
+        for (int j=0; j<n; j++) {
+            double w = 2*pi*j/n;
+            float *e = v + PRODUCER_ENTRYSIZE*(i*n+j);
+            
+            e[0]=(float) ((R+r*cos(w))*cos(u));
+            e[1]=(float) ((R+r*cos(w))*sin(u));
+            e[2]=(float) (r*sin(w));
+            
+            e[3]=(float) (cos(w)*cos(u));
+            e[4]=(float) (cos(w)*sin(u));
+            e[5]=(float) sin(w);
+            
+            e[6]=(float) (0.5+0.5*cos(u));
+            e[7]=(float) (0.5+0.5*sin(w));
+            e[8]=0.8f;
+        }
+    }
+}
+
+/** Fills out the facets of a torus with n x n vertices, two for each square of the grid */
+static void producer_facets(unsigned int *f, int n) {
+    for (int i=0; i<n; i++) {
+        for (int j=0; j<n; j++) {
+            unsigned int a = i*n+j, b = ((i+1)%n)*n+j;
+            unsigned int c = ((i+1)%n)*n+(j+1)%n, d = i*n+(j+1)%n;
+            unsigned int *e = f + 6*(i*n+j);
+            
+            e[0]=a; e[1]=b; e[2]=c;
+            e[3]=a; e[4]=c; e[5]=d;
+        }
+    }
+}
+
+/* -------------------------------------------------------
+ * Output
+ * ------------------------------------------------------- */
+
+/** Writes a whole buffer to a file descriptor */
+static int producer_write(int fd, const char *data, size_t length) {
+    while (length>0) {
+        ssize_t n = write(fd, data, length);
+        if (n<0 && errno==EINTR) continue;
+        if (n<=0) return 0;
+        data+=n;
+        length-=(size_t) n;
+    }
+    return 1;
+}
+
+/** Connects to a viewer started with --server */
+static int producer_connect(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    if (strlen(path)>=sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd>=0 && connect(fd, (struct sockaddr *) &addr, sizeof(addr))!=0) {
+        close(fd);
+        fd=-1;
+    }
+    return fd;
+}
+
+/** Set when the producer is interrupted */
+static volatile sig_atomic_t producerquit = 0;
+
+static void producer_signal(int sig) {
+    producerquit=1;
+}
+
+/** Waits until the viewer has finished with the commands */
+static void producer_wait(int fd, int socket, const char *name) {
+    if (socket) { /* The server closes the connection once it has parsed the commands */
+        char c;
+        shutdown(fd, SHUT_WR);
+        while (read(fd, &c, 1)>0 || (errno==EINTR && !producerquit));
+        return;
+    }
+    
+    /* The viewer only finishes parsing at the end of its input, so close the output and wait to be interrupted */
+    close(fd);
+    fprintf(stderr, "morphoview-shmproducer: Holding shared memory %s; interrupt to remove it.\n", name);
+    while (!producerquit) pause();
+}
+
+int main(int argc, const char *argv[]) {
+    int n=PRODUCER_RESOLUTION;
+    const char *socketpath=NULL;
+    
+    for (int i=1; i<argc; i++) {
+        if (argv[i][0]=='-' && argv[i][1]!='\0' && i+1<argc) {
+            switch (argv[i][1]) {
+                case 'n': n=atoi(argv[++i]); continue;
+                case 's': socketpath=argv[++i]; continue;
+            }
+        }
+        fprintf(stderr, "Usage: morphoview-shmproducer [-n resolution] [-s socket]\n");
+        return 1;
+    }
+    if (n<3) n=3;
+    
+    /* Lay out the vertices followed by the facets in a new segment */
+    char name[64];
+    snprintf(name, sizeof(name), "/morphoview-producer-%ld", (long) getpid());
+    
+    size_t nvertices = (size_t) n*n, nindices = 6*(size_t) n*n;
+    size_t vsize = sizeof(float)*PRODUCER_ENTRYSIZE*nvertices, isize = sizeof(unsigned int)*nindices;
+    
+    int shm = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (shm<0 || ftruncate(shm, (off_t) (vsize+isize))!=0) {
+        fprintf(stderr, "morphoview-shmproducer: Couldn't create shared memory %s: %s.\n", name, strerror(errno));
+        if (shm>=0) shm_unlink(name);
+        return 1;
+    }
+    
+    char *base = mmap(NULL, vsize+isize, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+    close(shm);
+    if (base==MAP_FAILED) {
+        fprintf(stderr, "morphoview-shmproducer: Couldn't map shared memory %s.\n", name);
+        shm_unlink(name);
+        return 1;
+    }
+    
+    producer_vertices((float *) base, n);
+    producer_facets((unsigned int *) (base+vsize), n);
+    munmap(base, vsize+isize);
+    
+    /* The commands refer to the data rather than containing it */
+    char commands[1024];
+    int length=snprintf(commands, sizeof(commands),
+                        "S 0 3\n"
+                        "W \"Shared memory\"\n"
+                        "o 1\n"
+                        "M \"%s\" 0 %zu \"xnc\"\n"
+                        "M \"%s\" %zu %zu \"f\"\n"
+                        "i\n"
+                        "s 0.6\n"
+                        "d 1\n",
+                        name, PRODUCER_ENTRYSIZE*nvertices, name, vsize, nindices);
+    
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, producer_signal);
+    signal(SIGTERM, producer_signal);
+    signal(SIGHUP, producer_signal);
+    
+    int fd = (socketpath ? producer_connect(socketpath) : STDOUT_FILENO);
+    int success = (fd>=0 && producer_write(fd, commands, (size_t) length));
+    
+    if (success) producer_wait(fd, socketpath!=NULL, name);
+    else fprintf(stderr, "morphoview-shmproducer: Couldn't send commands.\n");
+    
+    shm_unlink(name);
+    return (success ? 0 : 1);
+}